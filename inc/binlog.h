@@ -0,0 +1,149 @@
+/*
+ * binlog.h
+ * 
+ * Deferred binary logging over the buffered UART.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef BINLOG_H_
+#define BINLOG_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stddef.h>     //size_t type, NULL pointer
+#include <stdint.h>     //uint8_t type
+
+
+
+//default to file 0, define a unique number (0-15) before including
+//this header in every source file that logs
+#ifndef BINLOG_FILE_ID
+    #define BINLOG_FILE_ID 0
+#endif
+
+//maximum number of argument bytes per record
+#ifndef BINLOG_ARGS_MAX
+    #define BINLOG_ARGS_MAX 16
+#endif
+
+/** Number of log site ID bits used for the line number. */
+#define BINLOG_LINE_BITS 12
+/** Number of bytes in front of the argument bytes of every record. */
+#define BINLOG_HEADER_LEN 3
+
+/** Log site ID of the line this macro is expanded in. */
+#define BINLOG_ID \
+    ((uint16_t)(((uint16_t)(BINLOG_FILE_ID) << BINLOG_LINE_BITS) \
+    | (__LINE__ & ((1 << BINLOG_LINE_BITS) - 1))))
+
+
+
+/**
+ * Log macros for zero to four arguments.
+ * Only the log site ID and the raw argument bytes are transmitted,
+ * the format string never makes it into the binary.
+ * It is only read by the table generator (tools/binlog.c),
+ * which the host side decoder needs to rebuild the text.
+ * The arguments are transmitted with the size of their type,
+ * so the conversion specifiers have to match exactly
+ * (%hhd, %hhu, %hhx, %c for 8 bit, %d, %u, %x for 16 bit,
+ * %ld, %lu, %lx for 32 bit, %f for float).
+ * For example:
+ * 
+ * #define BINLOG_FILE_ID 1
+ * #include "binlog.h"
+ * ...
+ * BINLOG2("adc %hhu: %u\n", channel, value);
+ */
+#define BINLOG0(fmt) \
+    binlog_write(BINLOG_ID, NULL, 0)
+#define BINLOG1(fmt, a) \
+    do { \
+        struct __attribute__((packed)) \
+            {__typeof__(a) a_;} binlog_args_ = {(a)}; \
+        binlog_write(BINLOG_ID, (uint8_t*)&binlog_args_, \
+            sizeof(binlog_args_)); \
+    } while(0)
+#define BINLOG2(fmt, a, b) \
+    do { \
+        struct __attribute__((packed)) \
+            {__typeof__(a) a_; __typeof__(b) b_;} \
+            binlog_args_ = {(a), (b)}; \
+        binlog_write(BINLOG_ID, (uint8_t*)&binlog_args_, \
+            sizeof(binlog_args_)); \
+    } while(0)
+#define BINLOG3(fmt, a, b, c) \
+    do { \
+        struct __attribute__((packed)) \
+            {__typeof__(a) a_; __typeof__(b) b_; __typeof__(c) c_;} \
+            binlog_args_ = {(a), (b), (c)}; \
+        binlog_write(BINLOG_ID, (uint8_t*)&binlog_args_, \
+            sizeof(binlog_args_)); \
+    } while(0)
+#define BINLOG4(fmt, a, b, c, d) \
+    do { \
+        struct __attribute__((packed)) \
+            {__typeof__(a) a_; __typeof__(b) b_; __typeof__(c) c_; \
+            __typeof__(d) d_;} \
+            binlog_args_ = {(a), (b), (c), (d)}; \
+        binlog_write(BINLOG_ID, (uint8_t*)&binlog_args_, \
+            sizeof(binlog_args_)); \
+    } while(0)
+
+
+
+/**
+ * Writes a single record (log site ID, number of argument bytes
+ * and the argument bytes, all little endian) into the transmit buffer
+ * of the uartint module, which has to be initialized.
+ * Never blocks: if the record doesn't fit into the transmit buffer
+ * it is dropped as a whole and counted, so the log stays decodable.
+ * Use the BINLOGx macros instead of calling this function directly.
+ * 
+ * @param id log site ID
+ * @param args location of the argument bytes
+ * @param len number of argument bytes (up to BINLOG_ARGS_MAX)
+ * @return 0 if the record was queued, 1 if it was dropped
+ */
+bool binlog_write(uint16_t id, uint8_t *args, size_t len);
+
+/**
+ * Returns the number of records dropped since the last call
+ * and resets the counter.
+ * 
+ * @return the number of dropped records
+ */
+uint16_t binlog_dropped(void);
+
+
+
+#endif /* BINLOG_H_ */
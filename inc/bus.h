@@ -0,0 +1,141 @@
+/*
+ * bus.h
+ * 
+ * Bus manager, ownership arbitration of the SPI and TWI hardware
+ * between blocking users and the interrupt engines.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef BUS_H_
+#define BUS_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stdint.h>     //uint8_t type
+
+
+
+/**
+ * Managed busses.
+ */
+typedef enum
+{
+    /** SPI hardware, shared by spi.h and spiint.h. */
+    BUS_SPI,
+    /** TWI hardware, shared by twi.h and twiint.h. */
+    BUS_TWI,
+    /** Number of managed busses. */
+    BUS_N
+} Bus_t;
+
+/** Owner id of a free bus, choose any other id for the users. */
+#define BUS_FREE 0
+
+/**
+ * Interrupt engine of a bus, registered by the engine itself
+ * (spiint_init, twiint_init), so only the engines in use are linked.
+ */
+typedef struct
+{
+    /** Holds the queue (e.g. spiint_lock). */
+    void (*lock)(void);
+    /** Lets the queue continue (e.g. spiint_unlock). */
+    void (*unlock)(void);
+    /** Returns if a transfer is running (e.g. spiint_isRunning). */
+    bool (*isRunning)(void);
+} Bus_engine_t;
+
+
+
+/**
+ * Registers the interrupt engine of a bus,
+ * called by the init function of the engine.
+ * Without an engine only the ownership of the bus is managed.
+ * 
+ * @param bus bus the engine drives
+ * @param engine the engine, has to stay in scope
+ */
+void bus_setEngine(Bus_t bus, const Bus_engine_t *engine);
+/**
+ * Acquires a bus without waiting.
+ * Fails if the bus is owned by someone else
+ * or if the interrupt engine (if registered) is currently running
+ * a transfer.
+ * On success the queue of the interrupt engine is held
+ * (spiint_lock/twiint_lock), its transfers submitted in the meantime
+ * are queued and started when the bus is released.
+ * Acquiring a bus that is already owned by the same owner succeeds,
+ * the first release frees it.
+ * 
+ * @param bus bus to acquire
+ * @param owner id of the new owner, not BUS_FREE
+ * @return 0 if the bus was acquired, 1 otherwise
+ */
+bool bus_tryAcquire(Bus_t bus, uint8_t owner);
+/**
+ * Acquires a bus, waiting in idle sleep until other owners released it
+ * and the transfer the interrupt engine is currently running completed.
+ * A running SPI stream (spiint_streamStart) is stopped
+ * at the end of its current half.
+ * Queued transfers of the interrupt engine wait until the bus
+ * is released, so blocking users don't have to wait for the whole queue.
+ * Other owners have to release the bus from an interrupt routine
+ * or a callback, otherwise this function never returns.
+ * Interrupts are enabled while waiting, the sleep mode
+ * and the interrupt flag are restored afterwards.
+ * 
+ * @param bus bus to acquire
+ * @param owner id of the new owner, not BUS_FREE
+ */
+void bus_acquire(Bus_t bus, uint8_t owner);
+/**
+ * Releases a bus and lets the interrupt engine continue its queue.
+ * Nothing happens if the bus isn't owned by the given owner.
+ * The interrupt engine continues in the hardware settings
+ * the owner left it in, unless its transfers have a configuration
+ * (e.g. spiint_initDeviceTransaction).
+ * 
+ * @param bus bus to release
+ * @param owner id of the current owner
+ */
+void bus_release(Bus_t bus, uint8_t owner);
+/**
+ * Returns the current owner of a bus.
+ * 
+ * @param bus bus to check
+ * @return id of the current owner or BUS_FREE
+ */
+uint8_t bus_owner(Bus_t bus);
+
+
+
+#endif /* BUS_H_ */
@@ -0,0 +1,120 @@
+/*
+ * crc.h
+ * 
+ * Table driven CRC-8/CRC-16 with the table generated at compile time
+ * and stored in program memory.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef CRC_H_
+#define CRC_H_
+
+
+
+#include <stddef.h>         //size_t type
+#include <stdint.h>         //uint8_t type
+#include <avr/pgmspace.h>   //PROGMEM
+
+
+
+//width of the CRC in bits, 8 or 16
+#ifndef CRC_WIDTH
+    #define CRC_WIDTH 8
+#endif
+
+//polynomial (MSB first, without the highest bit) and initial value,
+//default to CRC-8/SMBUS or CRC-16/CCITT-FALSE
+#ifndef CRC_POLY
+    #if CRC_WIDTH == 8
+        #define CRC_POLY 0x07
+    #else
+        #define CRC_POLY 0x1021
+    #endif
+#endif
+
+#ifndef CRC_INIT
+    #if CRC_WIDTH == 8
+        #define CRC_INIT 0x00
+    #else
+        #define CRC_INIT 0xFFFF
+    #endif
+#endif
+
+
+
+#if CRC_WIDTH == 8
+    /** CRC value type. */
+    typedef uint8_t Crc_t;
+    /** Reads an entry of the table. */
+    #define CRC_TABLE_READ(i) pgm_read_byte(&crc_table[(i)])
+#elif CRC_WIDTH == 16
+    /** CRC value type. */
+    typedef uint16_t Crc_t;
+    /** Reads an entry of the table. */
+    #define CRC_TABLE_READ(i) pgm_read_word(&crc_table[(i)])
+#else
+    #error "No valid CRC_WIDTH defined!"
+#endif
+
+/** Lookup table, generated from CRC_POLY, in program memory. */
+extern const Crc_t crc_table[256] PROGMEM;
+
+/**
+ * Updates a CRC with one byte, macro version for interrupt routines.
+ * Use only if really needed.
+ */
+#define CRC_UPDATE(crc, data) \
+    ((Crc_t)(((crc) << 8) \
+        ^ CRC_TABLE_READ((uint8_t)(((crc) >> (CRC_WIDTH-8)) ^ (data)))))
+
+
+
+/**
+ * Updates a CRC with one byte.
+ * 
+ * @param crc current CRC, start with CRC_INIT
+ * @param data byte to add
+ * @return the updated CRC
+ */
+Crc_t crc_update(Crc_t crc, uint8_t data);
+/**
+ * Updates a CRC with multiple bytes.
+ * 
+ * @param crc current CRC, start with CRC_INIT
+ * @param data location of the bytes to add
+ * @param len number of bytes to add
+ * @return the updated CRC
+ */
+Crc_t crc_compute(Crc_t crc, const uint8_t *data, size_t len);
+
+
+
+#endif /* CRC_H_ */
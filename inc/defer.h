@@ -0,0 +1,96 @@
+/*
+ * defer.h
+ * 
+ * Deferred call queue to move work out of interrupt routines.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef DEFER_H_
+#define DEFER_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stddef.h>     //size_t type
+#include <stdint.h>     //uint8_t type
+
+
+
+//default to 8 pending calls
+#ifndef DEFER_N
+    #define DEFER_N 8
+#endif
+
+
+
+/**
+ * Deferred function type, gets the argument given when it was posted.
+ */
+typedef void (*Defer_t)(void *arg);
+
+
+
+/**
+ * Queues a function to be called later by defer_dispatch.
+ * Can be called from interrupt routines (bottom half of a driver)
+ * and from the main loop.
+ * If the queue is full, the call is dropped and counted.
+ * 
+ * @param function function to call
+ * @param arg argument to call the function with
+ * @return 0 if the call was queued, 1 if it was dropped
+ */
+bool defer_post(Defer_t function, void *arg);
+/**
+ * Calls all queued functions in the order they were posted,
+ * including the ones posted while dispatching.
+ * Meant to be called from the main loop, e.g.:
+ * 
+ * while(1)
+ * {
+ *     defer_dispatch();
+ *     doOtherStuff();
+ * }
+ * 
+ * @return the number of functions called
+ */
+size_t defer_dispatch(void);
+/**
+ * Returns the number of dropped calls since the last call
+ * and resets the counter.
+ * 
+ * @return the number of dropped calls
+ */
+uint8_t defer_dropped(void);
+
+
+
+#endif /* DEFER_H_ */
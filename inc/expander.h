@@ -0,0 +1,197 @@
+/*
+ * expander.h
+ * 
+ * Write combining driver for I2C GPIO expanders (PCF8574, MCP23017)
+ * on twiint.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef EXPANDER_H_
+#define EXPANDER_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stdint.h>     //uint8_t type
+#include "twiint.h"     //Twiint_t
+
+
+
+/**
+ * Supported expanders.
+ */
+typedef enum
+{
+    /** 8 quasi bidirectional pins (PCF8574/PCF8574A). */
+    EXPANDER_PCF8574,
+    /** 16 pins, port A pins 0-7, port B pins 8-15 (MCP23017). */
+    EXPANDER_MCP23017
+} Expander_type_t;
+
+/**
+ * GPIO expander, initialize it with expander_init,
+ * it must not go out of scope afterwards.
+ */
+typedef struct Expander_t
+{
+    /** Running transaction, used internally. */
+    Twiint_t transaction;
+    /** Type of the expander. */
+    Expander_type_t type;
+    /** Address of the expander (7-bit). */
+    uint8_t address;
+    /** Pins used as inputs. */
+    uint16_t inputs;
+    /** Shadow of the outputs. */
+    volatile uint16_t output;
+    /** Inputs at the last completed read. */
+    volatile uint16_t input;
+    /** If the outputs changed since the last write was started. */
+    volatile bool dirty;
+    /** If the inputs should be read. */
+    volatile bool readPending;
+    /** Ticks changes are combined before they are written. */
+    uint16_t window;
+    /** Ticks until the combined changes are written. */
+    uint16_t windowCountdown;
+    /** Ticks between two scheduled reads, 0 for none. */
+    uint16_t readPeriod;
+    /** Ticks until the next scheduled read. */
+    uint16_t readCountdown;
+    /** Number of failed transactions. */
+    volatile uint16_t errors;
+    /** Transaction buffers. */
+    uint8_t outBuf[3], inBuf[2];
+    /** Next expander, used internally. */
+    struct Expander_t *next;
+} Expander_t;
+
+
+
+/**
+ * Initializes an expander with all outputs low
+ * and adds it to the ones served by expander_tick.
+ * Configures the input pins (MCP23017: as inputs with pull-ups
+ * and interrupt on change, INTA and INTB mirrored;
+ * PCF8574: written high) and reads them, blocking.
+ * twiint_init has to be called before.
+ * 
+ * @param expander pointer to the expander
+ * @param type type of the expander
+ * @param address address of the expander (7-bit)
+ * @param inputs pins used as inputs
+ * @param window ticks changes of the outputs are combined
+ * into one write, 0 to write on the next tick
+ * @param readPeriod ticks between two reads of the inputs,
+ * 0 to read only on expander_interrupt
+ * @return 0 on success, 1 if the expander didn't respond
+ */
+bool expander_init(Expander_t *expander, Expander_type_t type,
+    uint8_t address, uint16_t inputs, uint16_t window, uint16_t readPeriod);
+
+/**
+ * Advances all expanders, call it at a constant rate from one context
+ * (e.g. a timer interrupt or the main loop).
+ * Writes the outputs of an expander when they changed and the window
+ * since the first change passed, all changes in between are combined
+ * into one write. Reads the inputs when requested by expander_interrupt
+ * or scheduled. At most one transaction per expander is queued (twiint)
+ * at a time, a write goes first.
+ */
+void expander_tick(void);
+/**
+ * Requests a read of the inputs on the next tick,
+ * call it from the interrupt routine of the pin the INT line of the
+ * expander is connected to (e.g. a pin change interrupt).
+ * 
+ * @param expander pointer to the expander
+ */
+void expander_interrupt(Expander_t *expander);
+/**
+ * Returns true if changed outputs haven't been written yet
+ * or a transaction is running.
+ * 
+ * @param expander pointer to the expander
+ * @return if the expander is busy
+ */
+bool expander_isBusy(const Expander_t *expander);
+
+/**
+ * Sets an output in the shadow.
+ * 
+ * @param expander pointer to the expander
+ * @param pin number of the pin
+ * @param value new state of the output
+ */
+void expander_set(Expander_t *expander, uint8_t pin, bool value);
+/**
+ * Toggles an output in the shadow.
+ * 
+ * @param expander pointer to the expander
+ * @param pin number of the pin
+ */
+void expander_toggle(Expander_t *expander, uint8_t pin);
+/**
+ * Sets multiple outputs in the shadow at once.
+ * 
+ * @param expander pointer to the expander
+ * @param value new states of the outputs
+ * @param mask outputs to change
+ */
+void expander_write(Expander_t *expander, uint16_t value, uint16_t mask);
+/**
+ * Returns the state of an output in the shadow.
+ * 
+ * @param expander pointer to the expander
+ * @param pin number of the pin
+ * @return state of the output
+ */
+bool expander_getOutput(const Expander_t *expander, uint8_t pin);
+
+/**
+ * Returns the state of an input at the last completed read.
+ * 
+ * @param expander pointer to the expander
+ * @param pin number of the pin
+ * @return state of the input
+ */
+bool expander_get(const Expander_t *expander, uint8_t pin);
+/**
+ * Returns the states of all pins at the last completed read.
+ * 
+ * @param expander pointer to the expander
+ * @return states of the pins
+ */
+uint16_t expander_read(const Expander_t *expander);
+
+
+
+#endif /* EXPANDER_H_ */
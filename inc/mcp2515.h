@@ -0,0 +1,190 @@
+/*
+ * mcp2515.h
+ * 
+ * MCP2515 CAN controller driver on spiint
+ * (interrupt driven receive queue, transmit mailboxes).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef MCP2515_H_
+#define MCP2515_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stdint.h>     //uint8_t type
+#include "spiint.h"     //Spi_device_t
+
+
+
+//oscillator of the MCP2515 (8 or 16MHz on most modules)
+#ifndef MCP2515_OSC
+    #define MCP2515_OSC 16000000UL
+#endif
+
+//CAN bitrate
+#ifndef MCP2515_BITRATE
+    #define MCP2515_BITRATE 500000UL
+#endif
+
+//number of frames the receive queue can hold
+#ifndef MCP2515_RX_FRAMES
+    #define MCP2515_RX_FRAMES 8
+#endif
+
+//default to external interrupt 0
+//INT of the MCP2515 is the interrupts pin: PD2 for INT0, PD3 for INT1
+#ifndef MCP2515_INT
+    #define MCP2515_INT 0
+#endif
+
+/** Number of transmit mailboxes (TXB0-TXB2). */
+#define MCP2515_MAILBOXES 3
+/** Mailbox argument to use any free mailbox. */
+#define MCP2515_ANY 0xFF
+
+
+
+/**
+ * CAN frame.
+ */
+typedef struct
+{
+    /** Identifier, 11 or 29 bits. */
+    uint32_t id;
+    /** If the identifier is an extended (29 bit) one. */
+    bool extended;
+    /** If the frame is a remote frame (no data). */
+    bool rtr;
+    /** Number of data bytes (0-8). */
+    uint8_t len;
+    /** Data bytes. */
+    uint8_t data[8];
+} Mcp2515_frame_t;
+
+
+
+/**
+ * Resets and initializes the MCP2515 to MCP2515_BITRATE in normal mode,
+ * receiving all frames (masks cleared), RXB0 rolling over into RXB1.
+ * Configures the external interrupt MCP2515_INT (low level)
+ * the INT line is connected to, it starts a queued read of the frames
+ * into the receive queue, so no spiint transactions are needed
+ * from the main loop to receive.
+ * spiint_init has to be called before, the SS pin has to be configured
+ * as output (high) and interrupts have to be enabled.
+ * 
+ * @param device the MCP2515, has to stay in scope
+ * @return 0 on success, 1 if the MCP2515 didn't respond
+ */
+bool mcp2515_init(const Spi_device_t *device);
+
+/**
+ * Sets an acceptance mask, blocking.
+ * Mask 0 belongs to RXB0 (filters 0 & 1),
+ * mask 1 belongs to RXB1 (filters 2 - 5).
+ * Identifier bits that are cleared in the mask are accepted
+ * regardless of the filters.
+ * The MCP2515 is put into configuration mode for the change
+ * and doesn't receive or transmit in the meantime.
+ * 
+ * @param mask number of the mask (0-1)
+ * @param id identifier bits to compare
+ * @param extended if the mask is for extended identifiers
+ * @return 0 on success, 1 if the mode couldn't be changed
+ */
+bool mcp2515_setMask(uint8_t mask, uint32_t id, bool extended);
+/**
+ * Sets an acceptance filter, blocking.
+ * Filters 0 & 1 belong to RXB0, filters 2 - 5 to RXB1,
+ * frames matching RXB0 roll over into RXB1 if RXB0 is full.
+ * A filter only matches frames with the same identifier type.
+ * The MCP2515 is put into configuration mode for the change
+ * and doesn't receive or transmit in the meantime.
+ * 
+ * @param filter number of the filter (0-5)
+ * @param id identifier to accept
+ * @param extended if the identifier is an extended one
+ * @return 0 on success, 1 if the mode couldn't be changed
+ */
+bool mcp2515_setFilter(uint8_t filter, uint32_t id, bool extended);
+
+/**
+ * Queues a frame into a transmit mailbox and returns immediately.
+ * The MCP2515 sends the frame as soon as the bus allows,
+ * the mailbox is freed when it was sent.
+ * Frames in different mailboxes may be sent in any order,
+ * use the same mailbox for frames that have to stay in order.
+ * 
+ * @param mailbox number of the mailbox (0-2) or MCP2515_ANY
+ * @param frame frame to send, copied
+ * @return 0 if the frame was queued, 1 if the mailbox is busy
+ */
+bool mcp2515_transmit(uint8_t mailbox, const Mcp2515_frame_t *frame);
+/**
+ * Returns true if a mailbox has a frame that hasn't been sent yet.
+ * 
+ * @param mailbox number of the mailbox (0-2)
+ * @return if the mailbox is busy
+ */
+bool mcp2515_isPending(uint8_t mailbox);
+
+/**
+ * Returns the number of frames in the receive queue.
+ * 
+ * @return number of received frames
+ */
+uint8_t mcp2515_available(void);
+/**
+ * Takes the oldest frame from the receive queue.
+ * 
+ * @param frame location where the frame should be written to
+ * @return 0 on success, 1 if the queue is empty
+ */
+bool mcp2515_receive(Mcp2515_frame_t *frame);
+
+/**
+ * Returns the number of frames dropped because the receive queue was full.
+ * 
+ * @return number of dropped frames
+ */
+uint16_t mcp2515_dropped(void);
+/**
+ * Returns the number of frames lost by the MCP2515
+ * because both receive buffers were full (RX0OVR/RX1OVR).
+ * 
+ * @return number of overruns
+ */
+uint16_t mcp2515_overruns(void);
+
+
+
+#endif /* MCP2515_H_ */
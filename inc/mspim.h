@@ -0,0 +1,120 @@
+/*
+ * mspim.h
+ * 
+ * Minimalistic, blocking SPI master on the USART (MSPIM).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef MSPIM_H_
+#define MSPIM_H_
+
+
+
+#include <stddef.h> //size_t type
+#include <stdint.h> //uint8_t type
+
+
+
+//default to 1MHz, the closest frequency not above is used
+//(F_CPU/2 maximum, F_CPU/8192 minimum)
+#ifndef MSPIM_FREQUENCY
+    #define MSPIM_FREQUENCY 1000000
+#endif
+
+//datasheet table 20-3
+//(UCPOL << 1) || (UCPHA << 0)
+#ifndef MSPIM_MODE
+    #define MSPIM_MODE 0
+#endif
+
+//0: MSB first, 1: LSB first
+#ifndef MSPIM_DORD
+    #define MSPIM_DORD 0
+#endif
+
+
+
+/**
+ * Initializes the USART in Master SPI mode to operate at MSPIM_FREQUENCY
+ * and in MSPIM_MODE and in MSPIM_DORD.
+ * Configures XCK (PD4) as clock output, TXD (PD1) is MOSI
+ * and RXD (PD0) is MISO.
+ * Slave selects have to be handled by the caller.
+ * The USART is not available as a serial port anymore (uart, uartint).
+ */
+void mspim_init(void);
+
+/**
+ * Shifts out a single byte while simultaneously shifting one in.
+ * 
+ * @param data byte to shift out
+ * @return byte shifted in
+ */
+uint8_t mspim_writeRead(uint8_t data);
+/**
+ * Shifts out multiple bytes, ignoring the MISO data.
+ * The transmitter is double buffered, the next byte is written
+ * while the current one is shifting, so the clock runs
+ * continuously without gaps between the bytes
+ * as long as the loop keeps up with the clock.
+ * 
+ * @param out location of the bytes to shift out
+ * @param len number of bytes to shift out
+ */
+void mspim_writeBurst(uint8_t *out, size_t len);
+/**
+ * Shifts in multiple bytes while simultaneously shifting out zeros.
+ * 
+ * @param in location for the shifted in bytes to be written to
+ * @param len number of bytes to shift in
+ */
+void mspim_readBurst(uint8_t *in, size_t len);
+/**
+ * Shifts in multiple bytes while simultaneously shifting out
+ * a fill byte (e.g. 0xFF for SD cards), no transmit buffer is needed.
+ * 
+ * @param in location for the shifted in bytes to be written to
+ * @param len number of bytes to shift in
+ * @param fill byte to shift out repeatedly
+ */
+void mspim_readBurstFill(uint8_t *in, size_t len, uint8_t fill);
+/**
+ * Shifts out multiple bytes while simultaneously shifting bytes in.
+ * 
+ * @param out location of the bytes to shift out
+ * @param in location for the shifted in bytes to be written to
+ * @param len number of bytes to shift out/in
+ */
+void mspim_writeReadBurst(uint8_t *out, uint8_t *in, size_t len);
+
+
+
+#endif /* MSPIM_H_ */
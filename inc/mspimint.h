@@ -0,0 +1,221 @@
+/*
+ * mspimint.h
+ * 
+ * Queued, interrupt based SPI master on the USART (MSPIM).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+#ifndef MSPIMINT_H_
+#define MSPIMINT_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stddef.h>     //size_t type
+#include <stdint.h>     //uint8_t type
+
+
+
+//default to 1MHz, the closest frequency not above is used
+//(F_CPU/2 maximum, F_CPU/8192 minimum)
+#ifndef MSPIM_FREQUENCY
+    #define MSPIM_FREQUENCY 1000000
+#endif
+
+//datasheet table 20-3
+//(UCPOL << 1) || (UCPHA << 0)
+#ifndef MSPIM_MODE
+    #define MSPIM_MODE 0
+#endif
+
+//0: MSB first, 1: LSB first
+#ifndef MSPIM_DORD
+    #define MSPIM_DORD 0
+#endif
+
+
+
+/**
+ * MSPIM transaction descriptor.
+ * Owned by the caller and must not be changed (or go out of scope)
+ * while it is queued.
+ */
+typedef struct Mspimint_t
+{
+    /** Location of the bytes to shift out
+     * or NULL to shift out fill (read only). */
+    uint8_t *out;
+    /** Location where the shifted in bytes will be written to
+     * or NULL to discard them (write only). */
+    uint8_t *in;
+    /** Byte shifted out repeatedly if out is NULL. */
+    uint8_t fill;
+    /** Number of bytes to shift out/in. */
+    size_t len;
+    /** Address of the PORT register the SS is connected to or NULL. */
+    volatile uint8_t *port;
+    /** Number of the corresponding bit (0-7) in the PORT register. */
+    uint8_t pin;
+    /** Set when the transaction is completed. */
+    volatile bool done;
+    /** Called when the transaction is completed (done is set) or NULL. */
+    void (*callback)(struct Mspimint_t *transaction);
+    /** If the callback is deferred to defer_dispatch (defer.h)
+     * instead of being called directly in the interrupt routine. */
+    bool deferred;
+    /** Next queued transaction, used internally. */
+    struct Mspimint_t *volatile next;
+} Mspimint_t;
+
+
+
+/**
+ * Transaction initializer, macro version.
+ * Use only if really needed.
+ */
+#define MSPIMINT_INIT(out_, in_, len_, port_, pin_) \
+    ((Mspimint_t){.out = (out_), .in = (in_), .fill = 0x00, .len = (len_), \
+        .port = (port_), .pin = (pin_), .done = true, \
+        .callback = NULL, .deferred = false, .next = NULL})
+
+
+
+/**
+ * Initializes the USART in Master SPI mode to operate at MSPIM_FREQUENCY
+ * and in MSPIM_MODE and in MSPIM_DORD.
+ * Configures XCK (PD4) as clock output, TXD (PD1) is MOSI
+ * and RXD (PD0) is MISO.
+ * The USART is not available as a serial port anymore (uart, uartint).
+ * Interrupts have to be enabled (by calling avr/interrupt.h's sei).
+ */
+void mspimint_init(void);
+
+/**
+ * Initializes a new transaction descriptor.
+ * 
+ * The fill byte defaults to 0x00.
+ * 
+ * @param out location of the bytes to shift out
+ * or NULL to shift out the fill byte (read only)
+ * @param in location where the shifted in bytes should be written to
+ * or NULL to discard them (write only)
+ * @param len number of bytes to shift out/in
+ * @param port address of the PORT register the SS is connected to
+ * or NULL if no SS signal should be used
+ * @param pin number of the corresponding bit (0-7) in the PORT register
+ * the SS is connected to
+ * @return a new transaction descriptor
+ */
+Mspimint_t mspimint_initTransaction(uint8_t *out, uint8_t *in, size_t len,
+    volatile uint8_t *port, uint8_t pin);
+
+/**
+ * Returns true if currently a transmission is ongoing or queued.
+ * 
+ * @return if currently a transmission is ongoing or queued
+ */
+bool mspimint_isBusy(void);
+/**
+ * Blocks until all queued transmissions are completed.
+ */
+void mspimint_flush(void);
+
+/**
+ * Appends a transaction to the queue and returns immediately.
+ * The transactions are executed in order, the interrupt routine
+ * raises the SS of a completed transaction, sets its done flag
+ * and directly starts the next one (pulling its SS low)
+ * without returning to the main loop in between.
+ * Within a transaction the data register empty interrupt keeps
+ * the double buffered transmitter filled, so there are no gaps
+ * between the bytes as long as the interrupts keep up with the clock.
+ * The done flag is cleared when the transaction is queued.
+ * A transaction must not be submitted again before it is done.
+ * If a callback is set, it is called with the completed transaction
+ * after the next one has already been started,
+ * either directly in the interrupt routine (keep it short, it may
+ * submit follow-up transactions) or, if deferred is set,
+ * later from the main loop by defer_dispatch.
+ * MSPIM transactions can't fail, so done is their only status.
+ * 
+ * @param transaction pointer to the transaction to queue
+ */
+void mspimint_submit(Mspimint_t *transaction);
+/**
+ * Sets the byte shifted out by a read only transaction (out is NULL),
+ * e.g. 0xFF for SD cards.
+ * 
+ * @param transaction pointer to the transaction
+ * @param fill byte to shift out repeatedly
+ */
+void mspimint_setFill(Mspimint_t *transaction, uint8_t fill);
+/**
+ * Sets the completion callback of a transaction.
+ * 
+ * @param transaction pointer to the transaction
+ * @param callback function to call on completion or NULL
+ * @param deferred if the callback should be called by defer_dispatch
+ * from the main loop instead of directly in the interrupt routine
+ */
+void mspimint_setCallback(Mspimint_t *transaction,
+    void (*callback)(Mspimint_t *transaction), bool deferred);
+
+/**
+ * Starts shifting out multiple bytes while simultaneously shifting bytes in.
+ * Pulls the SS pin low (if a PORT register is provided,
+ * if NULL is given, no SS actions will be taken) and starts
+ * shifting in and out bytes over the USART.
+ * This function then returns while the transmission continues,
+ * getting handled by interrupts routines.
+ * The data locations (out and in) must not be changed
+ * while the transmission is ongoing as the bytes are read/written as
+ * they are needed.
+ * When all bytes are shifted out/in the SS pin (if port not NULL)
+ * is set high again.
+ * The transmission is queued behind other submitted transactions.
+ * When a transmission started by this function is still ongoing,
+ * this function blocks until it is completed before queuing a new one.
+ * 
+ * @param out location of the bytes to shift out
+ * or NULL to shift out 0x00 (read only)
+ * @param in location where the shifted in bytes should be written to
+ * or NULL to discard them (write only)
+ * @param len number of bytes to shift out/in
+ * @param port address of the PORT register the SS is connected to
+ * or null in no SS signal should be used
+ * @param pin number of the corresponding bit (0-7) in the PORT register
+ * the SS i connected to
+ */
+void mspimint_transmitBurst(uint8_t *out, uint8_t *in, size_t len,
+    uint8_t *port, uint8_t pin);
+
+
+
+#endif /* MSPIMINT_H_ */
@@ -0,0 +1,147 @@
+/*
+ * norlog.h
+ * 
+ * Append only log store for SPI NOR flash (W25Qxx) on spiint.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef NORLOG_H_
+#define NORLOG_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stddef.h>     //size_t type
+#include <stdint.h>     //uint8_t type
+#include "spiint.h"     //Spi_device_t
+
+
+
+//size of the flash in 256 byte pages (4096 for a 1MB W25Q80),
+//the first 4K sector holds the log header, the rest the log
+#ifndef NORLOG_PAGES
+    #define NORLOG_PAGES 4096
+#endif
+
+/** Bytes of a flash page. */
+#define NORLOG_PAGE_LEN 256
+/** Bytes of a page header (epoch and used bytes). */
+#define NORLOG_HEADER_LEN 3
+/** Payload bytes of a log page. */
+#define NORLOG_PAYLOAD_LEN (NORLOG_PAGE_LEN - NORLOG_HEADER_LEN)
+
+
+
+/**
+ * Initializes the log store and recovers the write head
+ * by a binary search over the page headers
+ * (log pages are programmed in order, so the written ones form a prefix).
+ * spiint_init has to be called before, the SS pin has to be configured
+ * as output (high) and interrupts have to be enabled.
+ * 
+ * @param device the flash, has to stay in scope
+ * @return 0 if a log was found, 1 if the flash has to be formatted
+ */
+bool norlog_init(const Spi_device_t *device);
+/**
+ * Starts a new, empty log, blocking.
+ * Buffered data is discarded. Only the header sector is erased,
+ * the log sectors are erased in the background before they are reused,
+ * old pages are told apart by the epoch stored in every page header.
+ * The new epoch is above every epoch found in the sector headers,
+ * so stale pages never join the log (the whole log is erased once
+ * every epoch is used up).
+ */
+void norlog_format(void);
+
+/**
+ * Advances the background engine, call it regularly from the main loop.
+ * Programs filled pages while the next one fills,
+ * pre-erases the next sector and polls the flash for completion,
+ * at most one SPI exchange is started per call.
+ */
+void norlog_tick(void);
+/**
+ * Returns true if pages are waiting to be programmed
+ * or the flash is busy programming/erasing.
+ * 
+ * @return if the engine is busy
+ */
+bool norlog_isBusy(void);
+
+/**
+ * Appends bytes to the page buffer (doesn't access the flash).
+ * A full page is handed to the background engine and the second buffer
+ * starts filling. Bytes that don't fit (both buffers full or the flash
+ * full) are dropped and counted.
+ * Records can span pages, log self delimiting records.
+ * 
+ * @param data location of the bytes to append
+ * @param len number of bytes to append
+ * @return number of bytes appended
+ */
+size_t norlog_write(const void *data, size_t len);
+/**
+ * Hands a partially filled page to the background engine,
+ * the rest of the page stays unused.
+ */
+void norlog_flush(void);
+/**
+ * Flushes and blocks until all pages are programmed.
+ */
+void norlog_sync(void);
+
+/**
+ * Returns the number of programmed log pages.
+ * 
+ * @return number of programmed log pages
+ */
+uint16_t norlog_pages(void);
+/**
+ * Reads the payload of a log page, blocking.
+ * Waits for a running program/erase to complete first.
+ * 
+ * @param page number of the log page (0 is the oldest)
+ * @param data location where the NORLOG_PAYLOAD_LEN payload bytes
+ * should be written to
+ * @return number of used payload bytes, 0 if the page isn't programmed
+ */
+uint8_t norlog_readPage(uint16_t page, uint8_t *data);
+/**
+ * Returns the number of bytes dropped by norlog_write.
+ * 
+ * @return number of dropped bytes
+ */
+uint32_t norlog_dropped(void);
+
+
+
+#endif /* NORLOG_H_ */
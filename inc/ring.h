@@ -129,6 +129,17 @@ bool ring_push(Ring_t *ring, uint8_t data);
  * @return 0 if the element was pushed without overwriting data, 1 otherwise
  */
 bool ring_pushOver(Ring_t *ring, uint8_t data);
+/**
+ * Adds multiple elements to the ring buffer at once.
+ * If there is not enough space for all elements nothing will be changed
+ * and 1 will be returned, so the elements are either all pushed or none.
+ * 
+ * @param ring pointer to the ring buffer the elements should be pushed into
+ * @param data location of the elements that should be pushed
+ * @param len number of elements to push
+ * @return 0 if all elements were successfully pushed, 1 otherwise
+ */
+bool ring_pushBurst(Ring_t *ring, uint8_t *data, size_t len);
 
 /**
  * Retrieves the next element from the buffer to the given location
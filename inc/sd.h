@@ -0,0 +1,164 @@
+/*
+ * sd.h
+ * 
+ * SD/MMC card block driver over SPI with multi-block transfers
+ * and a write-back sector cache.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef SD_H_
+#define SD_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stddef.h>     //size_t type
+#include <stdint.h>     //uint8_t type
+
+
+
+//SPI clock during initialization (100-400kHz)
+#ifndef SD_INIT_FREQUENCY
+    #define SD_INIT_FREQUENCY 400000
+#endif
+
+//SPI clock after initialization, the closest not above is used
+#ifndef SD_FREQUENCY
+    #define SD_FREQUENCY 25000000
+#endif
+
+//number of cached sectors (512 bytes of RAM each), 0 for no cache
+#ifndef SD_CACHE_SECTORS
+    #define SD_CACHE_SECTORS 1
+#endif
+
+//maximum number of bytes to poll while waiting for the card
+#ifndef SD_TIMEOUT
+    #define SD_TIMEOUT 500000UL
+#endif
+
+//maximum number of initialization commands (ACMD41/CMD1) to send
+#ifndef SD_INIT_TRIES
+    #define SD_INIT_TRIES 4000
+#endif
+
+/** Bytes per sector. */
+#define SD_SECTOR_LEN 512
+
+
+
+/**
+ * Card types.
+ */
+typedef enum
+{
+    /** No (initialized) card. */
+    SD_NONE,
+    /** MMC version 3. */
+    SD_MMC,
+    /** SD version 1. */
+    SD_V1,
+    /** SD version 2 standard capacity. */
+    SD_V2,
+    /** SD version 2 high/extended capacity (block addressed). */
+    SD_V2HC
+} Sd_type_t;
+
+
+
+/**
+ * Initializes the card at SD_INIT_FREQUENCY and switches
+ * to SD_FREQUENCY afterwards.
+ * Only the spi.h API is used (spi_init has to be called before),
+ * the configuration is applied whenever the card is selected,
+ * so the bus can be shared with other devices.
+ * 
+ * @param port address of the PORT register the CS is connected to
+ * @param pin number of the corresponding bit (0-7) in the PORT register
+ * @return 0 if a card was initialized, 1 otherwise
+ */
+bool sd_init(volatile uint8_t *port, uint8_t pin);
+/**
+ * Returns the type of the initialized card.
+ * 
+ * @return the card type or SD_NONE
+ */
+Sd_type_t sd_type(void);
+
+/**
+ * Reads sectors from the card,
+ * multiple sectors are streamed with one command (CMD18).
+ * Sectors in the cache are taken from there.
+ * 
+ * @param sector number of the first sector
+ * @param data location for the sectors to be written to
+ * (count*SD_SECTOR_LEN bytes)
+ * @param count number of sectors to read
+ * @return 0 if all sectors were read, 1 otherwise
+ */
+bool sd_read(uint32_t sector, uint8_t *data, size_t count);
+/**
+ * Writes sectors to the card,
+ * multiple sectors are streamed with one command (CMD25)
+ * with the card pre-erasing them (ACMD23).
+ * Cached copies of the sectors are dropped.
+ * 
+ * @param sector number of the first sector
+ * @param data location of the sectors (count*SD_SECTOR_LEN bytes)
+ * @param count number of sectors to write
+ * @return 0 if all sectors were written, 1 otherwise
+ */
+bool sd_write(uint32_t sector, uint8_t *data, size_t count);
+
+#if SD_CACHE_SECTORS
+/**
+ * Returns the cached copy of a sector, reading it on a miss.
+ * The least recently used sector is evicted (and written back
+ * if it was changed). Meant for often used sectors like
+ * file system tables and directories.
+ * The pointer is valid until the next sd_cache call.
+ * 
+ * @param sector number of the sector
+ * @param write if the sector will be changed (written back later)
+ * @return location of the SD_SECTOR_LEN cached bytes or NULL on error
+ */
+uint8_t *sd_cache(uint32_t sector, bool write);
+/**
+ * Writes back all changed sectors of the cache.
+ * 
+ * @return 0 if all sectors were written, 1 otherwise
+ */
+bool sd_sync(void);
+#endif
+
+
+
+#endif /* SD_H_ */
@@ -0,0 +1,158 @@
+/*
+ * shiftreg.h
+ * 
+ * Background refresh engine for daisy chained 74HC595 output
+ * and 74HC165 input shift registers on spiint.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef SHIFTREG_H_
+#define SHIFTREG_H_
+
+
+
+#include <avr/io.h>     //PORTB, ...
+#include <stdbool.h>    //bool type
+#include <stdint.h>     //uint8_t type
+#include "spiint.h"     //Spi_config_t
+
+
+
+//number of 74HC595 (outputs) and 74HC165 (inputs) in the chains, at least 1
+#ifndef SHIFTREG_OUT_LEN
+    #define SHIFTREG_OUT_LEN 1
+#endif
+#ifndef SHIFTREG_IN_LEN
+    #define SHIFTREG_IN_LEN 1
+#endif
+
+//ticks between two refreshes (up to 65535),
+//0 to refresh only when outputs changed
+#ifndef SHIFTREG_INTERVAL
+    #define SHIFTREG_INTERVAL 0
+#endif
+#if SHIFTREG_INTERVAL < 0 || SHIFTREG_INTERVAL > 0xFFFF
+    #error "SHIFTREG_INTERVAL out of range (0 to 65535)"
+#endif
+
+//latch of the 74HC595s (RCLK), used as SS of the transactions
+#ifndef SHIFTREG_LATCH_PORT
+    #define SHIFTREG_LATCH_PORT PORTB
+    #define SHIFTREG_LATCH_DDR DDRB
+    #define SHIFTREG_LATCH_PIN 1
+#endif
+
+//parallel load of the 74HC165s (SH/LD), pulsed low before every refresh
+#ifndef SHIFTREG_LOAD_PORT
+    #define SHIFTREG_LOAD_PORT PORTB
+    #define SHIFTREG_LOAD_DDR DDRB
+    #define SHIFTREG_LOAD_PIN 0
+#endif
+
+
+
+/**
+ * Initializes the engine, all outputs low.
+ * Configures the latch and load pins as outputs (high).
+ * spiint_init has to be called before and the SPI has to run MSB first.
+ * Output (and input) bit n is bit n%8 (Q0-Q7 or A-H) of register n/8,
+ * register 0 being the one connected to the microcontroller.
+ * 
+ * @param config SPI configuration of the chains or NULL to keep the
+ * current one, has to stay in scope
+ */
+void shiftreg_init(const Spi_config_t *config);
+
+/**
+ * Advances the engine, call it at a constant rate
+ * (e.g. from a timer interrupt or the main loop).
+ * A refresh (shifting out the outputs and shifting in the inputs)
+ * is started if outputs changed or every SHIFTREG_INTERVAL ticks,
+ * but only if the last one is completed.
+ * All changes in between are combined into one refresh.
+ */
+void shiftreg_tick(void);
+/**
+ * Returns true if a refresh is ongoing or outputs changed
+ * that haven't been shifted out yet.
+ * 
+ * @return if outputs are pending
+ */
+bool shiftreg_isBusy(void);
+
+/**
+ * Sets an output in the shadow image.
+ * 
+ * @param bit number of the output
+ * @param value new state of the output
+ */
+void shiftreg_set(uint16_t bit, bool value);
+/**
+ * Toggles an output in the shadow image.
+ * 
+ * @param bit number of the output
+ */
+void shiftreg_toggle(uint16_t bit);
+/**
+ * Sets multiple outputs of one register in the shadow image at once.
+ * 
+ * @param reg number of the register
+ * @param value new states of the outputs
+ * @param mask outputs to change
+ */
+void shiftreg_write(uint8_t reg, uint8_t value, uint8_t mask);
+/**
+ * Returns the state of an output in the shadow image.
+ * 
+ * @param bit number of the output
+ * @return state of the output
+ */
+bool shiftreg_getOutput(uint16_t bit);
+
+/**
+ * Returns the state of an input at the last completed refresh.
+ * 
+ * @param bit number of the input
+ * @return state of the input
+ */
+bool shiftreg_get(uint16_t bit);
+/**
+ * Returns the states of all inputs of one register
+ * at the last completed refresh.
+ * 
+ * @param reg number of the register
+ * @return states of the inputs
+ */
+uint8_t shiftreg_read(uint8_t reg);
+
+
+
+#endif /* SHIFTREG_H_ */
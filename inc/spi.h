@@ -65,6 +65,33 @@
 
 
 
+/**
+ * SPI configuration (mode, bit order and clock) of a device
+ * as register values.
+ */
+typedef struct
+{
+    /** SPI control register value (SPIE excluded). */
+    uint8_t spcr;
+    /** SPI status register value (SPI2X). */
+    uint8_t spsr;
+} Spi_config_t;
+
+/**
+ * SPI device handler, configuration and slave select.
+ */
+typedef struct
+{
+    /** Configuration to apply when the device is selected. */
+    Spi_config_t config;
+    /** Address of the PORT register the SS is connected to or NULL. */
+    volatile uint8_t *port;
+    /** Number of the corresponding bit (0-7) in the PORT register. */
+    uint8_t pin;
+} Spi_device_t;
+
+
+
 /**
  * Initializes the SPI peripherals to operate at SPI_FREQUENCY
  * (maximum and optionally SPI_MIN_FREQUENCY minimum)
@@ -76,6 +103,59 @@
  */
 void spi_init(void);
 
+/**
+ * Calculates the register values for a device in master mode,
+ * so that every device on the bus can run at its own maximum rate.
+ * The fastest clock (prescaler 2 to 128) not above the given frequency
+ * is used, or the slowest if the frequency is lower than all of them.
+ * 
+ * @param frequency maximum SPI clock of the device in Hz
+ * @param mode SPI mode 0-3 (CPOL << 1) | (CPHA << 0), datasheet table 19-2
+ * @param dord 0: MSB first, 1: LSB first
+ * @return the configuration register values
+ */
+Spi_config_t spi_initConfig(uint32_t frequency, uint8_t mode, uint8_t dord);
+/**
+ * Initializes a new device handler.
+ * 
+ * @param frequency maximum SPI clock of the device in Hz
+ * @param mode SPI mode 0-3 (CPOL << 1) | (CPHA << 0), datasheet table 19-2
+ * @param dord 0: MSB first, 1: LSB first
+ * @param port address of the PORT register the SS is connected to
+ * or NULL if no SS signal should be used
+ * @param pin number of the corresponding bit (0-7) in the PORT register
+ * the SS is connected to
+ * @return a new device handler
+ */
+Spi_device_t spi_initDevice(uint32_t frequency, uint8_t mode, uint8_t dord,
+    volatile uint8_t *port, uint8_t pin);
+/**
+ * Applies a configuration to the SPI hardware.
+ * The interrupt enable bit (SPIE) is kept as it is.
+ * 
+ * @param config configuration to apply
+ */
+void spi_setConfig(Spi_config_t config);
+/**
+ * Returns the configuration currently applied to the SPI hardware,
+ * e.g. to restore it later.
+ * 
+ * @return the current configuration
+ */
+Spi_config_t spi_getConfig(void);
+/**
+ * Applies the configuration of a device and pulls its SS low (if any).
+ * 
+ * @param device device to select
+ */
+void spi_select(const Spi_device_t *device);
+/**
+ * Sets the SS of a device high again (if any).
+ * 
+ * @param device device to deselect
+ */
+void spi_deselect(const Spi_device_t *device);
+
 /**
  * Shifts out a single byte while simultaneously shifting one in.
  * 
@@ -85,6 +165,11 @@ void spi_init(void);
 uint8_t spi_writeRead(uint8_t data);
 /**
  * Shifts out multiple bytes, ignoring the MISO data.
+ * No receive buffer is needed.
+ * The burst functions fetch the next byte while the current one
+ * is shifting and start it right after SPIF is set,
+ * so the bytes follow each other with only a few cycles gap
+ * (see test/spibench_test.c).
  * 
  * @param out location of the bytes to shift out
  * @param len number of bytes to shift out
@@ -97,6 +182,15 @@ void spi_writeBurst(uint8_t *out, size_t len);
  * @param len number of bytes to shift in
  */
 void spi_readBurst(uint8_t *in, size_t len);
+/**
+ * Shifts in multiple bytes while simultaneously shifting out
+ * a fill byte (e.g. 0xFF for SD cards), no transmit buffer is needed.
+ * 
+ * @param in location for the shifted in bytes to be written to
+ * @param len number of bytes to shift in
+ * @param fill byte to shift out repeatedly
+ */
+void spi_readBurstFill(uint8_t *in, size_t len, uint8_t fill);
 /**
  * Shifts out multiple bytes while simultaneously shifting bytes in.
  * 
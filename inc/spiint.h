@@ -40,29 +40,80 @@
 #include <stdbool.h>    //bool type
 #include <stddef.h>     //size_t type
 #include <stdint.h>     //uint8_t type
+#include "spi.h"        //Spi_config_t, Spi_device_t, SPI_FREQUENCY, ...
+#ifndef SPIINT_NO_CRC
+    #include "crc.h"    //Crc_t, CRC_WIDTH, CRC_POLY, ...
+#endif
 
 
 
-//default to 1MHz
-#ifndef SPI_FREQUENCY
-    #define SPI_FREQUENCY 1000000
+#ifndef SPIINT_NO_CRC
+/** Transaction CRC flag, accumulate a CRC over the shifted out bytes. */
+#define SPIINT_CRC_OUT  0x01
+/** Transaction CRC flag, accumulate a CRC over the shifted in bytes. */
+#define SPIINT_CRC_IN   0x02
 #endif
 
-//set lower limit if needed
-#ifndef SPI_MIN_FREQUENCY
-    #define SPI_MIN_FREQUENCY 0
-#endif
 
-//datasheet table 19-2
-//(CPOL << 1) || (CPHA << 0)
-#ifndef SPI_MODE
-    #define SPI_MODE 0
-#endif
 
-//0: MSB first, 1: LSB first
-#ifndef SPI_DORD
-    #define SPI_DORD 0
+/**
+ * SPI transaction descriptor.
+ * Owned by the caller and must not be changed (or go out of scope)
+ * while it is queued.
+ */
+typedef struct Spiint_t
+{
+    /** Location of the bytes to shift out
+     * or NULL to shift out fill (read only). */
+    uint8_t *out;
+    /** Location where the shifted in bytes will be written to
+     * or NULL to discard them (write only). */
+    uint8_t *in;
+    /** Byte shifted out repeatedly if out is NULL. */
+    uint8_t fill;
+#ifndef SPIINT_NO_CRC
+    /** CRCs to accumulate (SPIINT_CRC_OUT, SPIINT_CRC_IN), 0 for none. */
+    uint8_t crcFlags;
+    /** CRC over the shifted out bytes, valid when done. */
+    Crc_t crcOut;
+    /** CRC over the shifted in bytes, valid when done. */
+    Crc_t crcIn;
 #endif
+    /** Number of bytes to shift out/in. */
+    size_t len;
+    /** Address of the PORT register the SS is connected to or NULL. */
+    volatile uint8_t *port;
+    /** Number of the corresponding bit (0-7) in the PORT register. */
+    uint8_t pin;
+    /** If SS is kept low after completion, so that the next transaction
+     * (submitted together, e.g. the data after a command) continues
+     * the same frame. */
+    bool hold;
+    /** Configuration applied before SS is pulled low
+     * or NULL to keep the current one. */
+    const Spi_config_t *config;
+    /** Set when the transaction is completed. */
+    volatile bool done;
+    /** Called when the transaction is completed (done is set) or NULL. */
+    void (*callback)(struct Spiint_t *transaction);
+    /** If the callback is deferred to defer_dispatch (defer.h)
+     * instead of being called directly in the interrupt routine. */
+    bool deferred;
+    /** Next queued transaction, used internally. */
+    struct Spiint_t *volatile next;
+} Spiint_t;
+
+
+
+/**
+ * Transaction initializer, macro version.
+ * Use only if really needed.
+ */
+#define SPIINT_INIT(out_, in_, len_, port_, pin_) \
+    ((Spiint_t){.out = (out_), .in = (in_), .fill = 0x00, .len = (len_), \
+        .port = (port_), .pin = (pin_), .hold = false, .config = NULL, \
+        .done = true, \
+        .callback = NULL, .deferred = false, .next = NULL})
 
 
 
@@ -74,20 +125,133 @@
  * and MISO (PB4) as input.
  * SS (PB2) has to be kept as output so that the SPI hardware
  * doesn't switch into slave mode.
+ * Registers spiint as the engine of BUS_SPI (bus.h).
  * Interrupts have to be enabled (by calling avr/interrupt.h's sei).
  */
 void spiint_init(void);
 
 /**
- * Returns true if currently a transmission is ongoing.
+ * Initializes a new transaction descriptor.
+ * 
+ * The fill byte defaults to 0x00.
+ * 
+ * @param out location of the bytes to shift out
+ * or NULL to shift out the fill byte (read only)
+ * @param in location where the shifted in bytes should be written to
+ * or NULL to discard them (write only)
+ * @param len number of bytes to shift out/in
+ * @param port address of the PORT register the SS is connected to
+ * or NULL if no SS signal should be used
+ * @param pin number of the corresponding bit (0-7) in the PORT register
+ * the SS is connected to
+ * @return a new transaction descriptor
+ */
+Spiint_t spiint_initTransaction(uint8_t *out, uint8_t *in, size_t len,
+    volatile uint8_t *port, uint8_t pin);
+/**
+ * Initializes a new transaction descriptor for a device (spi.h).
+ * The configuration of the device (mode, bit order and clock)
+ * is applied when the transaction starts, before its SS is pulled low,
+ * so devices with different settings can share the queue.
+ * The device must not go out of scope while the transaction is queued.
+ * 
+ * @param device device to transfer to/from
+ * @param out location of the bytes to shift out or NULL (read only)
+ * @param in location where the shifted in bytes should be written to
+ * or NULL (write only)
+ * @param len number of bytes to shift out/in
+ * @return a new transaction descriptor
+ */
+Spiint_t spiint_initDeviceTransaction(const Spi_device_t *device,
+    uint8_t *out, uint8_t *in, size_t len);
+
+/**
+ * Returns true if currently a transmission is ongoing or queued.
  * 
- * @return if currently a transmission is ongoing
+ * @return if currently a transmission is ongoing or queued
  */
 bool spiint_isBusy(void);
 /**
- * Blocks until the transmission is completed.
+ * Blocks until all queued transmissions are completed.
  */
 void spiint_flush(void);
+/**
+ * Returns true if a transaction is currently shifting,
+ * queued transactions held by spiint_lock don't count.
+ * 
+ * @return if a transaction is currently shifting
+ */
+bool spiint_isRunning(void);
+
+/**
+ * Appends a transaction to the queue and returns immediately.
+ * The transactions are executed in order, the interrupt routine
+ * raises the SS of a completed transaction, sets its done flag
+ * and directly starts the next one (pulling its SS low)
+ * without returning to the main loop in between.
+ * The done flag is cleared when the transaction is queued.
+ * A transaction must not be submitted again before it is done.
+ * If a callback is set, it is called with the completed transaction
+ * after the next one has already been started,
+ * either directly in the interrupt routine (keep it short, it may
+ * submit follow-up transactions) or, if deferred is set,
+ * later from the main loop by defer_dispatch.
+ * SPI transactions can't fail, so done is their only status.
+ * 
+ * @param transaction pointer to the transaction to queue
+ */
+void spiint_submit(Spiint_t *transaction);
+/**
+ * Holds the queue so that the SPI hardware can be used by someone else
+ * (e.g. spi.h, see bus.h).
+ * A running transaction is still completed, the following ones are kept
+ * queued and the SPI interrupt is disabled,
+ * so blocking transfers can poll SPIF.
+ * A running stream is stopped at the end of its current half
+ * (or fill byte) like by spiint_streamStop, it isn't resumed on unlock.
+ * Wait for spiint_isRunning to return false before using the hardware.
+ */
+void spiint_lock(void);
+/**
+ * Releases the queue held by spiint_lock,
+ * re-enables the SPI interrupt and starts the queued transactions.
+ * Transactions without a configuration keep the settings
+ * the hardware was left in.
+ */
+void spiint_unlock(void);
+/**
+ * Sets the byte shifted out by a read only transaction (out is NULL),
+ * e.g. 0xFF for SD cards.
+ * 
+ * @param transaction pointer to the transaction
+ * @param fill byte to shift out repeatedly
+ */
+void spiint_setFill(Spiint_t *transaction, uint8_t fill);
+#ifndef SPIINT_NO_CRC
+/**
+ * Lets a transaction accumulate CRCs (crc.h) over its bytes
+ * in the interrupt routine, while the bytes are shifting,
+ * so no second pass over the buffers is needed.
+ * The CRCs are reset to CRC_INIT by this function, not by submitting,
+ * so a CRC can span multiple submissions of the same transaction
+ * (e.g. a header and then the payload).
+ * Define SPIINT_NO_CRC to remove the CRC support (and its table).
+ * 
+ * @param transaction pointer to the transaction
+ * @param flags SPIINT_CRC_OUT and/or SPIINT_CRC_IN or 0 for none
+ */
+void spiint_setCrc(Spiint_t *transaction, uint8_t flags);
+#endif
+/**
+ * Sets the completion callback of a transaction.
+ * 
+ * @param transaction pointer to the transaction
+ * @param callback function to call on completion or NULL
+ * @param deferred if the callback should be called by defer_dispatch
+ * from the main loop instead of directly in the interrupt routine
+ */
+void spiint_setCallback(Spiint_t *transaction,
+    void (*callback)(Spiint_t *transaction), bool deferred);
 
 /**
  * Starts shifting out multiple bytes while simultaneously shifting bytes in.
@@ -101,11 +265,14 @@ void spiint_flush(void);
  * they are needed.
  * When all bytes are shifted out/in the SS pin (if port not NULL)
  * is set high again.
- * When an transmission is still ongoing, this function blocks until the
- * transmission is completed before starting a new one.
+ * The transmission is queued behind other submitted transactions.
+ * When a transmission started by this function is still ongoing,
+ * this function blocks until it is completed before queuing a new one.
  * 
  * @param out location of the bytes to shift out
+ * or NULL to shift out 0x00 (read only)
  * @param in location where the shifted in bytes should be written to
+ * or NULL to discard them (write only)
  * @param len number of bytes to shift out/in
  * @param port address of the PORT register the SS is connected to
  * or null in no SS signal should be used
@@ -116,5 +283,65 @@ void spiint_transmitBurst(uint8_t *out, uint8_t *in, size_t len,
     uint8_t *port, uint8_t pin);
 
 
+/**
+ * Starts shifting out a continuous, double buffered stream
+ * (e.g. to DACs or LED drivers), MISO is ignored.
+ * Both halves of the buffer have to be filled before starting.
+ * When a half has been shifted out the other half follows
+ * right away and the application gets the half done event
+ * (callback and/or spiint_streamFree), fills the half
+ * and hands it back with spiint_streamCommit.
+ * If the next half isn't committed in time, 0x00 fill bytes are
+ * shifted out until it is and the underrun counter is incremented.
+ * The stream runs until spiint_streamStop or spiint_lock (e.g. by
+ * bus_acquire) is called, submitted transactions stay queued
+ * in the meantime.
+ * It starts only if no transaction is running or queued
+ * and spiint isn't locked.
+ * 
+ * @param buf location of the two halves (2*len bytes)
+ * @param len number of bytes of one half
+ * @param port address of the PORT register the SS is connected to
+ * or NULL if no SS signal should be used
+ * @param pin number of the corresponding bit (0-7) in the PORT register
+ * the SS is connected to
+ * @param callback function called with the shifted out half or NULL,
+ * directly in the interrupt routine (keep it short)
+ * or if deferred is set later by defer_dispatch (defer.h)
+ * @param deferred if the callback should be called by defer_dispatch
+ * @return 0 if the stream was started, 1 otherwise
+ */
+bool spiint_streamStart(uint8_t *buf, size_t len,
+    volatile uint8_t *port, uint8_t pin,
+    void (*callback)(uint8_t *half), bool deferred);
+/**
+ * Stops the stream at the end of the current half (or fill byte),
+ * raises its SS and starts the queued transactions.
+ * spiint_isRunning returns false when it is stopped.
+ */
+void spiint_streamStop(void);
+/**
+ * Returns a half of the stream that has been shifted out
+ * and can be filled again or NULL if there is none.
+ * 
+ * @return location of a free half or NULL
+ */
+uint8_t *spiint_streamFree(void);
+/**
+ * Hands a filled half back to the stream.
+ * 
+ * @param half location of the half, as given by the callback
+ * or spiint_streamFree
+ */
+void spiint_streamCommit(uint8_t *half);
+/**
+ * Returns the number of times the stream ran out of committed halves
+ * since it was started.
+ * 
+ * @return the number of underruns
+ */
+uint16_t spiint_streamUnderruns(void);
+
+
 
 #endif /* SPIINT_H_ */
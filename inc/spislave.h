@@ -0,0 +1,147 @@
+/*
+ * spislave.h
+ * 
+ * Buffered, interrupt based SPI slave driver with SS framing.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef SPISLAVE_H_
+#define SPISLAVE_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stddef.h>     //size_t type
+#include <stdint.h>     //uint8_t type
+
+
+
+//datasheet table 19-2
+//(CPOL << 1) || (CPHA << 0)
+#ifndef SPISLAVE_MODE
+    #define SPISLAVE_MODE 0
+#endif
+
+//0: MSB first, 1: LSB first
+#ifndef SPISLAVE_DORD
+    #define SPISLAVE_DORD 0
+#endif
+
+//size of the receive and transmit fifos, can hold one byte less
+#ifndef SPISLAVE_BUF_LEN
+    #define SPISLAVE_BUF_LEN 64
+#endif
+
+//number of received frames that can be queued
+#ifndef SPISLAVE_FRAMES
+    #define SPISLAVE_FRAMES 8
+#endif
+
+//byte shifted out when the transmit fifo is empty
+#ifndef SPISLAVE_FILL
+    #define SPISLAVE_FILL 0xFF
+#endif
+
+
+
+/**
+ * Initializes the SPI peripherals as slave in SPISLAVE_MODE
+ * and in SPISLAVE_DORD.
+ * Configures MISO (PB4) as output and SS, MOSI & SCK (PB2, PB3 & PB5)
+ * as inputs. MISO is only driven while SS is low.
+ * SS edges are detected with the pin change interrupt of PB2 (PCINT2),
+ * every low period of SS is one frame.
+ * The host may clock at most F_CPU/4, the interrupt routine has to
+ * reload the data register between two bytes, so the sustained rate
+ * also depends on the gaps the host leaves between the bytes
+ * (watch spislave_underruns and spislave_overflows, see
+ * test/spislave_test.c).
+ * Interrupts have to be enabled (by calling avr/interrupt.h's sei).
+ */
+void spislave_init(void);
+
+/**
+ * Returns the number of bytes that can be queued for transmission.
+ * 
+ * @return the number of bytes that fit into the transmit fifo
+ */
+size_t spislave_transmitAvailable(void);
+/**
+ * Queues multiple bytes to be shifted out when the host clocks.
+ * The bytes form a continuous stream, they are not bound to frames.
+ * If there is not enough space for all of them none are queued.
+ * 
+ * @param data location of the bytes to queue
+ * @param len number of bytes to queue
+ * @return 0 if all bytes were queued, 1 otherwise
+ */
+bool spislave_transmitTry(uint8_t *data, size_t len);
+
+/**
+ * Returns the number of completely received frames.
+ * 
+ * @return the number of frames that can be popped
+ */
+size_t spislave_frameAvailable(void);
+/**
+ * Pops the oldest completely received frame.
+ * Frames that didn't fit into the receive fifo are dropped as a whole
+ * (counted by spislave_overflows).
+ * Bytes that don't fit into the given location are discarded.
+ * 
+ * @param data location where the frame should be written to
+ * @param len size of the location
+ * @return length of the frame or 0 if no frame is available
+ */
+size_t spislave_receiveFrame(uint8_t *data, size_t len);
+
+/**
+ * Returns the number of times the transmit fifo ran empty while
+ * the host was clocking (SPISLAVE_FILL was sent instead).
+ * A run of fill bytes counts once per frame,
+ * so write only hosts increase this counter once per frame.
+ * 
+ * @return the number of transmit underruns
+ */
+uint16_t spislave_underruns(void);
+/**
+ * Returns the number of received frames that were dropped because
+ * the receive fifo or the frame queue was full.
+ * Frames are dropped as a whole, spislave_receiveFrame never returns
+ * a truncated one.
+ * 
+ * @return the number of receive overflows
+ */
+uint16_t spislave_overflows(void);
+
+
+
+#endif /* SPISLAVE_H_ */
@@ -0,0 +1,191 @@
+/*
+ * suart.h
+ * 
+ * Buffered, timer and interrupt based software UART driver.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef SUART_H_
+#define SUART_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stddef.h>     //size_t type, NULL pointer
+#include <stdint.h>     //uint8_t type
+#include <stdio.h>      //FILE type
+
+
+
+//default to 9600, up to 38400 at 16MHz
+#ifndef SUART_BAUD
+    #define SUART_BAUD 9600
+#endif
+
+//default to 80 (standard number of columns in the terminal)
+#ifndef SUART_BUF_LEN
+    #define SUART_BUF_LEN 80
+#endif
+
+//default to timer 0
+//TX is the timers OCxB pin: PD5 for timer 0, PD3 for timer 2
+#ifndef SUART_TIMER
+    #define SUART_TIMER 0
+#endif
+
+//default to external interrupt 0
+//RX is the interrupts pin: PD2 for INT0, PD3 for INT1
+#ifndef SUART_INT
+    #define SUART_INT 0
+#endif
+
+
+
+/** Stream that outputs to the software UART. */
+extern FILE suart_out;
+/** Stream that reads from the software UART. */
+extern FILE suart_in;
+
+
+
+/**
+ * Initializes the SUART_TIMER and the external interrupt SUART_INT
+ * to transmit on the timers OCxB pin and receive on the interrupt pin
+ * (8 data bits, no parity, 1 stop bit) at SUART_BAUD.
+ * The timer runs freely, each bit is timed by a compare match interrupt:
+ * transmitted bits are set by the output compare hardware (no jitter)
+ * and received bits are sampled in the middle, starting from the falling
+ * edge of the start bit detected by the external interrupt.
+ * The timer can therefore not be used by other modules (e.g. servo or pid).
+ * Streams are not redirected, use suart_out and suart_in explicitly.
+ * Interrupts have to be enabled (by calling avr/interrupt.h's sei).
+ * On default, the receiver fifo rejects new data when it overflows
+ * but by defining SUART_OVERWRITE old data will be overwritten on overflow.
+ */
+void suart_init(void);
+
+/**
+ * Reads available bytes from the receive buffer to the provided location
+ * and returns the location when a complete line (\n terminated)
+ * or (len-1) characters have been received
+ * (the string will then be \0 terminated) or NULL otherwise.
+ * Works the same as uartint_ngets.
+ * 
+ * @param s string is is beeing built
+ * @param len maximum number of characters to read (including \0 terminator)
+ * @return s when a line was completed
+ * (line terminator or character limit reached)
+ * or NULL is there are no more characters in the receive buffer
+ */
+char *suart_ngets(char *s, size_t len);
+
+/**
+ * Returns the number of free bytes in the transmit buffer.
+ * 
+ * @return the number of free bytes in the transmit buffer
+ */
+size_t suart_transmitAvailable(void);
+/**
+ * Blocks until all bytes in the transmit buffer have been transmitted
+ * including the stop bit of the last byte.
+ */
+void suart_transmitFlush(void);
+/**
+ * Adds a byte to the transmit buffer.
+ * If there are no free locations in the transmit buffer,
+ * this function blocks until it can add the byte to the buffer.
+ * 
+ * @param data byte to add to the transmit buffer
+ * @return 0 if the byte was successfully added to the buffer, 1 otherwise
+ */
+bool suart_transmit(uint8_t data);
+/**
+ * Adds multiple bytes to the transmit buffer.
+ * If there are not enough locations in the transmit buffer,
+ * this function blocks until it can add all bytes to the buffer.
+ * 
+ * @param data location of the bytes that should be added to the buffer
+ * @return number of bytes that have successfully been added to the buffer
+ * (len on success)
+ */
+size_t suart_transmitBurst(uint8_t *data, size_t len);
+/**
+ * Adds multiple bytes to the transmit buffer without blocking.
+ * Either all bytes are added or, if there are not enough free locations
+ * in the transmit buffer, none at all.
+ * 
+ * @param data location of the bytes that should be added to the buffer
+ * @param len number of bytes to add
+ * @return 0 if all bytes were added to the buffer, 1 otherwise
+ */
+bool suart_transmitTry(uint8_t *data, size_t len);
+
+/**
+ * Returns the number of bytes in the receive buffer available to be read.
+ */
+size_t suart_receiveAvailable(void);
+/**
+ * Reads a single byte from the receive buffer without removing it
+ * and writes it to the provided location.
+ * 
+ * @return 0 on success, otherwise 1 (no bytes available)
+ */
+bool suart_receivePeek(uint8_t *data);
+/**
+ * Removes a single byte from the receive buffer
+ * and writes it to the provided location.
+ * 
+ * @return 0 on success, otherwise 1 (no bytes available)
+ */
+bool suart_receive(uint8_t *data);
+/**
+ * Removes up to (len) bytes from the receive buffer
+ * and writes them to the provided location.
+ * Stops when either (len) bytes have have been read
+ * or there are no more bytes in the receive buffer.
+ * 
+ * @param data location for the received bytes to be written to
+ * @param len number of received bytes to read
+ * @return the number of bytes that have been read (len on success)
+ */
+size_t suart_receiveBurst(uint8_t *data, size_t len);
+/**
+ * Returns the number of received bytes with an invalid stop bit
+ * (framing errors) since the last call and resets the counter.
+ * These bytes are discarded.
+ * 
+ * @return the number of framing errors
+ */
+uint8_t suart_frameErrors(void);
+
+
+
+#endif /* SUART_H_ */
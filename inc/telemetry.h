@@ -0,0 +1,153 @@
+/*
+ * telemetry.h
+ * 
+ * Delta and varint compressed telemetry stream over the buffered UART.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stdint.h>     //int16_t type
+
+
+
+//default to 8 (all ADC channels), at most 83 (records stay one COBS block)
+#ifndef TELEMETRY_N_MAX
+    #define TELEMETRY_N_MAX 8
+#endif
+#if TELEMETRY_N_MAX < 1 || TELEMETRY_N_MAX > 83
+    #error "TELEMETRY_N_MAX out of range (1 to 83)"
+#endif
+
+/** Header flag of a keyframe record (absolute values). */
+#define TELEMETRY_KEY 0x80
+/** Header mask of the sequence number. */
+#define TELEMETRY_SEQ 0x7F
+/** Frame delimiter, never part of an encoded record. */
+#define TELEMETRY_DELIMITER 0x00
+/** CRC-8/SMBUS polynomial of the check byte. */
+#define TELEMETRY_CRC_POLY 0x07
+/**
+ * Maximum length of a record
+ * (header, 3 varint bytes per channel and check byte).
+ */
+#define TELEMETRY_RECORD_MAX (2 + 3*TELEMETRY_N_MAX)
+/** Maximum length of a frame (COBS code byte, record and delimiter). */
+#define TELEMETRY_FRAME_MAX (TELEMETRY_RECORD_MAX + 2)
+
+
+
+/**
+ * Telemetry stream handler.
+ */
+typedef struct
+{
+    /** Last transmitted values, the reference for the deltas. */
+    int16_t *last;
+    /** Number of channels, at most TELEMETRY_N_MAX. */
+    uint8_t n;
+    /** Number of records from keyframe to keyframe. */
+    uint8_t interval;
+    /** Number of records until the next keyframe, 0 forces one. */
+    uint8_t countdown;
+    /** Sequence number of the next record. */
+    uint8_t seq;
+    /** Number of records that didn't fit into the transmit buffer. */
+    uint16_t dropped;
+} Telemetry_t;
+
+
+
+/**
+ * Initializer macro version.
+ * Use only if really needed.
+ * n is clamped to TELEMETRY_N_MAX.
+ */
+#define TELEMETRY_INIT(last_, n_, interval_) \
+    ((Telemetry_t){.last = (last_), \
+        .n = ((n_) > TELEMETRY_N_MAX) ? TELEMETRY_N_MAX : (n_), \
+        .interval = (interval_), .countdown = 0, .seq = 0, .dropped = 0})
+
+
+
+/**
+ * Initializes a new telemetry stream handler.
+ * Every record starts with a header byte (TELEMETRY_KEY flag
+ * and 7 bit sequence number) followed by one zigzag varint per channel,
+ * the difference to the last transmitted value
+ * or the absolute value in keyframes.
+ * The first record is always a keyframe.
+ * A CRC-8 check byte closes the record.
+ * Every record is sent COBS encoded and terminated by
+ * TELEMETRY_DELIMITER, so the host finds the record boundaries again
+ * after lost or corrupted bytes, drops the damaged record
+ * and waits for the next keyframe.
+ * The uartint module has to be initialized before writing records.
+ * 
+ * @param last location for the reference values (n many)
+ * @param n number of channels, clamped to TELEMETRY_N_MAX
+ * (last has to hold the clamped number of values)
+ * @param interval number of records from keyframe to keyframe
+ * (1 for keyframes only)
+ * @return a new telemetry stream handler
+ */
+Telemetry_t telemetry_init(int16_t *last, uint8_t n, uint8_t interval);
+
+/**
+ * Encodes one sample of every channel into a record
+ * and adds it to the uartint transmit buffer without blocking.
+ * If the record doesn't fit into the transmit buffer it is dropped
+ * (and counted) and the next record is encoded against
+ * the same reference values, so the host never gets out of sync.
+ * Unsigned samples (e.g. from the ADC) can be passed in as well,
+ * the differences wrap around consistently.
+ * 
+ * @param stream pointer to the stream handler
+ * @param samples location of the samples (n many)
+ * @return 0 if the record was queued, 1 if it was dropped
+ * (or n exceeds TELEMETRY_N_MAX)
+ */
+bool telemetry_write(Telemetry_t *stream, int16_t *samples);
+/**
+ * Makes the next record a keyframe,
+ * e.g. when a host (re)connects to the stream.
+ * 
+ * @param stream pointer to the stream handler
+ */
+void telemetry_keyframe(Telemetry_t *stream);
+
+
+
+#endif /* TELEMETRY_H_ */
@@ -48,6 +48,16 @@
     #define TWI_FREQUENCY 400000
 #endif
 
+//microseconds to wait for a condition/byte to complete before the bus is
+//considered stuck and recovered (including clock stretching),
+//approximate: a lower bound, polling adds a few cycles per microsecond
+#ifndef TWI_TIMEOUT
+    #define TWI_TIMEOUT 10000
+#endif
+#if TWI_TIMEOUT < 1 || TWI_TIMEOUT > 0xFFFFFFFF
+    #error "TWI_TIMEOUT out of range (1 to 2^32-1)"
+#endif
+
 
 
 /**
@@ -55,6 +65,25 @@
  * Configures SCL and SDA (PC5 and PC4) as outputs.
  */
 void twi_init(void);
+/**
+ * Frees a stuck bus, e.g. a slave holding SDA low in the middle of a byte
+ * after a reset of the master or a glitch.
+ * Disables the TWI hardware, clocks out up to 9 SCL pulses by GPIO
+ * until the slave releases SDA, generates a STOP condition
+ * and initializes the TWI hardware again (twi_init).
+ * Blocks for about 100us.
+ * 
+ * @return 0 if the bus is free, 1 if SDA is still held low
+ */
+bool twi_recover(void);
+/**
+ * Returns true if a function failed since the last twi_start
+ * because the hardware didn't complete in TWI_TIMEOUT,
+ * the bus has been recovered (twi_recover) in that case.
+ * 
+ * @return if a timeout occurred
+ */
+bool twi_timedOut(void);
 
 
 
@@ -53,25 +53,232 @@
 /** Slave address with read intend. */
 #define TWI_ADDRESS_R(x)    (((x) << 1) | 0x01)
 
+//how often a transaction is restarted after the slave didn't acknowledge
+//its address (e.g. an EEPROM in its write cycle) or after the arbitration
+//was lost, before the failure is reported
+#ifndef TWIINT_NACK_RETRIES
+    #define TWIINT_NACK_RETRIES 0
+#endif
+#ifndef TWIINT_ARB_RETRIES
+    #define TWIINT_ARB_RETRIES 3
+#endif
+
+//period of twiint_tick in milliseconds, it has to be called at this
+//fixed rate (e.g. from a timer interrupt)
+#ifndef TWIINT_TICK_MS
+    #define TWIINT_TICK_MS 1
+#endif
+//milliseconds without any bus progress after which a stuck transaction
+//is aborted by twiint_tick, the bus recovered (twi_recover)
+//and the queue continued, 0 to disable,
+//leave room for slaves that stretch the clock
+#ifndef TWIINT_TIMEOUT_MS
+    #define TWIINT_TIMEOUT_MS 10
+#endif
+#if TWIINT_TICK_MS < 1
+    #error "TWIINT_TICK_MS has to be at least 1!"
+#endif
+/** Ticks of the timeout, the first tick of a transaction is partial. */
+#define TWIINT_TIMEOUT_TICKS \
+    ((TWIINT_TIMEOUT_MS) ? (TWIINT_TIMEOUT_MS + TWIINT_TICK_MS - 1) \
+        / TWIINT_TICK_MS + 1 : 0)
+#if TWIINT_TIMEOUT_TICKS > 0xFFFF
+    #error "TWIINT_TIMEOUT_MS too long for TWIINT_TICK_MS!"
+#endif
+
+//microseconds twiint_flush waits without any bus progress before
+//it aborts the running transaction like twiint_tick
+//(approximate: a lower bound, polling adds a few cycles per microsecond)
+#ifndef TWIINT_FLUSH_TIMEOUT
+    #define TWIINT_FLUSH_TIMEOUT 10000
+#endif
+#if TWIINT_FLUSH_TIMEOUT < 1 || TWIINT_FLUSH_TIMEOUT > 0xFFFFFFFF
+    #error "TWIINT_FLUSH_TIMEOUT out of range (1 to 2^32-1)"
+#endif
+
+//if additionally the watchdog timer (in interrupt mode, about 16ms)
+//supervises the transactions, off by default: twiint then owns the WDT
+//and defines WDT_vect (no other watchdog use, no other WDT ISR)
+#ifndef TWIINT_WATCHDOG
+    #define TWIINT_WATCHDOG 0
+#endif
+
+//number of slave addresses with statistics, 0 to disable them
+#ifndef TWIINT_STATS
+    #define TWIINT_STATS 8
+#endif
+
+
+
+/**
+ * Status of a transmission.
+ */
+typedef enum
+{
+    /** Transmission ongoing. */
+    TWIINT_BUSY,
+    /** All bytes transmitted. */
+    TWIINT_OK,
+    /** Slave didn't acknowledge its address. */
+    TWIINT_ADDRESS_NACK,
+    /** Slave didn't acknowledge a written byte. */
+    TWIINT_DATA_NACK,
+    /** Arbitration lost more often than TWIINT_ARB_RETRIES. */
+    TWIINT_ARB_LOST,
+    /** Illegal START or STOP condition on the bus. */
+    TWIINT_BUS_ERROR,
+    /** The hardware didn't progress, the bus has been recovered. */
+    TWIINT_TIMEOUT,
+    /** Unexpected state. */
+    TWIINT_ERROR
+} Twiint_status_t;
+
+#if TWIINT_STATS
+/**
+ * Statistics of a slave address, every event is counted,
+ * including the ones that were retried.
+ */
+typedef struct
+{
+    /** Address of the slave (7-bit). */
+    uint8_t address;
+    /** Successful transactions. */
+    uint16_t ok;
+    /** Not acknowledged addresses or bytes. */
+    uint16_t nacks;
+    /** Lost arbitrations. */
+    uint16_t arbLost;
+    /** Bus errors and unexpected states. */
+    uint16_t errors;
+} Twiint_stats_t;
+#endif
+
+/**
+ * TWI transaction descriptor.
+ * Writes outLen bytes and then, after a repeated START, reads inLen bytes
+ * (only writing if inLen is 0, only reading if outLen is 0).
+ * Owned by the caller and must not be changed (or go out of scope)
+ * while it is queued.
+ */
+typedef struct Twiint_t
+{
+    /** Address of the slave (7-bit). */
+    uint8_t address;
+    /** Location of the bytes to write. */
+    uint8_t *out;
+    /** Number of bytes to write. */
+    size_t outLen;
+    /** Location where the read bytes will be written to. */
+    uint8_t *in;
+    /** Number of bytes to read. */
+    size_t inLen;
+    /** Result, TWIINT_BUSY while queued or running. */
+    volatile Twiint_status_t status;
+    /** Number of bytes transmitted (acknowledged writes and reads),
+     * how far a failed transaction got. */
+    volatile size_t count;
+    /** Hardware status (TW_STATUS of util/twi.h) the transaction
+     * ended with, for debugging failures. */
+    volatile uint8_t state;
+    /** Called when the transaction is completed or NULL. */
+    void (*callback)(struct Twiint_t *transaction);
+    /** If the callback is deferred to defer_dispatch (defer.h)
+     * instead of being called directly in the interrupt routine. */
+    bool deferred;
+    /** Next queued transaction, used internally. */
+    struct Twiint_t *volatile next;
+} Twiint_t;
+
+
+
+/**
+ * Transaction initializer, macro version.
+ * Use only if really needed.
+ */
+#define TWIINT_INIT(address_, out_, outLen_, in_, inLen_) \
+    ((Twiint_t){.address = (address_), .out = (out_), .outLen = (outLen_), \
+        .in = (in_), .inLen = (inLen_), .status = TWIINT_OK, .count = 0, \
+        .state = 0, .callback = NULL, .deferred = false, .next = NULL})
+
 
 
 /**
  * Initializes the TWI hardware for master mode operating at TWI_FREQUENCY.
  * Configures SCL and SDA (PC5 and PC4) as outputs.
+ * With TWIINT_WATCHDOG the application has to clear the watchdog reset
+ * flag (WDRF in MCUSR) after evaluating the reset cause,
+ * otherwise the watchdog timer can't run in interrupt mode.
+ * Registers twiint as the engine of BUS_TWI (bus.h).
  * Interrupts have to be enabled.
  */
 void twiint_init(void);
 
 /**
- * Returns true if currently a transmission is ongoing.
+ * Initializes a new transaction descriptor.
  * 
- * @return if currently a transmission is ongoing
+ * @param address address of the slave (7-bit)
+ * @param out location of the bytes to write
+ * @param outLen number of bytes to write
+ * @param in location where the read bytes should be written to
+ * @param inLen number of bytes to read
+ * @return a new transaction descriptor
+ */
+Twiint_t twiint_initTransaction(uint8_t address,
+    uint8_t *out, size_t outLen, uint8_t *in, size_t inLen);
+
+/**
+ * Returns true if currently a transmission is ongoing or queued.
+ * 
+ * @return if currently a transmission is ongoing or queued
  */
 bool twiint_busy(void);
 /**
- * Blocks until the transmission is completed.
+ * Blocks until all queued transmissions are completed.
+ * A running transaction without bus progress for TWIINT_FLUSH_TIMEOUT
+ * is aborted with TWIINT_TIMEOUT after recovering the bus
+ * (twi_recover), so the flush ends even if twiint_tick isn't called
+ * in the meantime. Returns early if the queue is held by twiint_lock.
+ * 
+ * @return 0 if all transactions completed, 1 if a transaction timed out
+ * or the queue is held
+ */
+bool twiint_flush(void);
+/**
+ * Returns true if a transmission is currently running on the bus,
+ * a transmission held by twiint_lock doesn't count.
+ * @return if a transmission is currently running
+ */
+bool twiint_isRunning(void);
+/**
+ * Returns the status of the last transmission started by
+ * twiint_start (or its combined variants),
+ * TWIINT_BUSY while it is still ongoing.
+ * 
+ * @return the status of the last transmission
+ */
+Twiint_status_t twiint_status(void);
+/**
+ * Returns the number of bytes transmitted by the last transmission
+ * started by twiint_start (or its combined variants),
+ * how far it got if it failed.
+ * 
+ * @return number of transmitted bytes
+ */
+size_t twiint_count(void);
+/**
+ * Sets a function that is called with the status
+ * whenever a transmission started by twiint_start
+ * (or its combined variants) is completed (successfully or not),
+ * either directly in the interrupt routine (keep it short,
+ * it may start a follow-up transmission) or, if deferred is set,
+ * later from the main loop by defer_dispatch (defer.h).
+ * 
+ * @param callback function to call on completion or NULL
+ * @param deferred if the callback should be called by defer_dispatch
+ * from the main loop instead of directly in the interrupt routine
  */
-void twiint_flush(void);
+void twiint_setCallback(void (*callback)(Twiint_status_t status),
+    bool deferred);
 
 /**
  * Starts a TWI transmission writing or reading multiple bytes.
@@ -83,8 +290,9 @@ void twiint_flush(void);
  * getting handled by interrupts routines.
  * The data location must not be changed while the transmission is ongoing
  * as the bytes are read/written as they are needed.
- * When an transmission is still ongoing, this function blocks until the
- * transmission is completed before starting a new one.
+ * The transmission is queued behind submitted transactions (twiint_submit).
+ * When a transmission started by this function is still ongoing,
+ * this function blocks until it is completed before queuing a new one.
  * 
  * @param address slave address byte, use the result of TWI_ADDRESS_W for write
  * intend or TWI_ADDRESS_R for read intend applied on the 7-bit address
@@ -93,6 +301,110 @@ void twiint_flush(void);
  * @param len number of bytes to write/read
  */
 void twiint_start(uint8_t address, uint8_t *data, size_t len);
+/**
+ * Starts a combined TWI transmission, first writing and then,
+ * after a repeated START, reading multiple bytes
+ * (START, SLA_W, DATA, ..., DATA,
+ * START, SLA_R, DATA+ACK, ..., DATA+ACK, DATA+NACK, STOP),
+ * the interrupt version of twi_readFromSlaveRegister.
+ * Both directions are handled by the interrupt routine,
+ * the bus isn't released in between.
+ * This function then returns while the transmission continues.
+ * The data locations must not be changed while the transmission is
+ * ongoing. When a transmission started by twiint_start (or its variants)
+ * is still ongoing, this function blocks until it is completed
+ * before queuing a new one.
+ * 
+ * @param address address of the slave (7-bit)
+ * @param out location of the bytes to write
+ * @param outLen number of bytes to write
+ * @param in location where the read bytes should be written to
+ * @param inLen number of bytes to read, at least 1
+ */
+void twiint_startWriteRead(uint8_t address, uint8_t *out, size_t outLen,
+    uint8_t *in, size_t inLen);
+/**
+ * Starts reading multiple bytes from a register of a slave,
+ * a combined transmission (twiint_startWriteRead)
+ * writing the single register byte.
+ * The register byte is copied, so it can be a temporary.
+ * 
+ * @param address address of the slave (7-bit)
+ * @param reg byte to write before reading from the slave
+ * @param data location where the bytes should be written to
+ * @param len number of bytes to read, at least 1
+ */
+void twiint_startReadRegister(uint8_t address, uint8_t reg,
+    uint8_t *data, size_t len);
+
+/**
+ * Appends a transaction to the queue and returns immediately.
+ * The transactions are executed in order, the interrupt routine
+ * records the result of a completed transaction and starts the next one
+ * right away (STOP directly followed by START)
+ * without returning to the main loop in between.
+ * The status is set to TWIINT_BUSY when the transaction is queued.
+ * A transaction must not be submitted again before it is completed.
+ * If a callback is set, it is called with the completed transaction
+ * after the next one has already been started,
+ * either directly in the interrupt routine (keep it short, it may
+ * submit follow-up transactions) or, if deferred is set,
+ * later from the main loop by defer_dispatch.
+ * 
+ * @param transaction pointer to the transaction to queue
+ */
+void twiint_submit(Twiint_t *transaction);
+/**
+ * Sets the completion callback of a transaction.
+ * 
+ * @param transaction pointer to the transaction
+ * @param callback function to call on completion or NULL
+ * @param deferred if the callback should be called by defer_dispatch
+ * from the main loop instead of directly in the interrupt routine
+ */
+void twiint_setTransactionCallback(Twiint_t *transaction,
+    void (*callback)(Twiint_t *transaction), bool deferred);
+
+/**
+ * Holds the queue so that the TWI hardware can be used
+ * by someone else (e.g. twi.h, see bus.h).
+ * A running transmission is still completed, transmissions started
+ * afterwards are kept queued (twiint_busy returns true)
+ * until twiint_unlock is called.
+ * Wait for twiint_isRunning to return false before using the hardware.
+ */
+void twiint_lock(void);
+/**
+ * Releases the hold of twiint_lock and starts the queued transmissions.
+ */
+void twiint_unlock(void);
+
+/**
+ * Supervises the running transaction, call it every TWIINT_TICK_MS
+ * milliseconds (e.g. from a timer interrupt).
+ * A transaction without bus progress for TWIINT_TIMEOUT_MS
+ * is aborted with TWIINT_TIMEOUT after recovering the bus,
+ * its callback (if not deferred) is called from here.
+ * Without calls there is no timeout (except in twiint_flush).
+ */
+void twiint_tick(void);
+
+#if TWIINT_STATS
+/**
+ * Copies the statistics of a slave address.
+ * The first TWIINT_STATS addresses that are used get statistics,
+ * further ones aren't counted.
+ * 
+ * @param address address of the slave (7-bit)
+ * @param stats location where the statistics should be written to
+ * @return 0 on success, 1 if the address has no statistics
+ */
+bool twiint_stats(uint8_t address, Twiint_stats_t *stats);
+/**
+ * Clears the statistics of all addresses.
+ */
+void twiint_clearStats(void);
+#endif
 
 
 
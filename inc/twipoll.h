@@ -0,0 +1,162 @@
+/*
+ * twipoll.h
+ * 
+ * Background I2C register polling on twiint
+ * (double buffered shadow copies with timestamps).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef TWIPOLL_H_
+#define TWIPOLL_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stdint.h>     //uint8_t type
+#include "twiint.h"     //Twiint_t, Twiint_status_t
+
+
+
+/** Size of the buffer of a block (two shadow copies). */
+#define TWIPOLL_BUF_LEN(len) (2 * (len))
+
+
+
+/**
+ * Register block of a slave that is polled periodically.
+ * Initialize it with twipoll_initBlock, it must not be changed
+ * (or go out of scope) while it is added.
+ */
+typedef struct Twipoll_t
+{
+    /** Transaction of the running poll, used internally. */
+    Twiint_t transaction;
+    /** Address of the slave (7-bit). */
+    uint8_t address;
+    /** First register of the block. */
+    uint8_t reg;
+    /** Number of registers (bytes) of the block. */
+    uint8_t len;
+    /** Location of the two shadow copies (TWIPOLL_BUF_LEN(len) bytes). */
+    uint8_t *buf;
+    /** Ticks between two polls. */
+    uint16_t period;
+    /** Ticks until the next poll. */
+    uint16_t countdown;
+    /** Copy holding the latest consistent snapshot (0 or 1). */
+    volatile uint8_t front;
+    /** If the snapshot is newer than the last twipoll_read. */
+    volatile bool fresh;
+    /** Tick (twipoll_now) the snapshot was completed at. */
+    volatile uint16_t timestamp;
+    /** Number of failed polls (the snapshot is kept). */
+    volatile uint16_t errors;
+    /** Next added block, used internally. */
+    struct Twipoll_t *next;
+} Twipoll_t;
+
+
+
+/**
+ * Initializes the engine, no blocks added and the tick at 0.
+ */
+void twipoll_init(void);
+
+/**
+ * Initializes a new block.
+ * The first poll is started offset ticks after the block is added,
+ * so the polls of blocks with the same period can be spread
+ * over the ticks to plan the bus utilization.
+ * 
+ * @param address address of the slave (7-bit)
+ * @param reg first register of the block
+ * @param buf location of TWIPOLL_BUF_LEN(len) bytes for the shadow copies
+ * @param len number of registers (bytes) of the block
+ * @param period ticks between two polls (at least 1)
+ * @param offset ticks until the first poll
+ * @return a new block
+ */
+Twipoll_t twipoll_initBlock(uint8_t address, uint8_t reg,
+    uint8_t *buf, uint8_t len, uint16_t period, uint16_t offset);
+/**
+ * Adds a block to the polled ones.
+ * twiint_init has to be called before.
+ * 
+ * @param block pointer to the block
+ */
+void twipoll_add(Twipoll_t *block);
+/**
+ * Advances the engine, call it at a constant rate from one context
+ * (e.g. a timer interrupt or the main loop).
+ * Starts the polls that are due as queued twiint transactions
+ * (twiint_startReadRegister like, with a repeated start),
+ * each reading into the copy that isn't the snapshot.
+ * The copies are swapped by the interrupt routine when a poll completed
+ * successfully. A poll that is still running when it is due again
+ * is started on the following tick.
+ */
+void twipoll_tick(void);
+/**
+ * Returns the number of ticks since twipoll_init (wrapping around),
+ * the time base of the timestamps.
+ * 
+ * @return current tick
+ */
+uint16_t twipoll_now(void);
+
+/**
+ * Copies the latest consistent snapshot of a block
+ * and clears its fresh flag.
+ * 
+ * @param block pointer to the block
+ * @param data location for len bytes
+ * @return tick the snapshot was completed at
+ */
+uint16_t twipoll_read(Twipoll_t *block, void *data);
+/**
+ * Returns true if a block has a snapshot
+ * newer than the last twipoll_read.
+ * 
+ * @param block pointer to the block
+ * @return if the snapshot is fresh
+ */
+bool twipoll_isFresh(const Twipoll_t *block);
+/**
+ * Returns the result of the last poll of a block.
+ * 
+ * @param block pointer to the block
+ * @return status of the last poll, TWIINT_BUSY while it is running
+ */
+Twiint_status_t twipoll_status(const Twipoll_t *block);
+
+
+
+#endif /* TWIPOLL_H_ */
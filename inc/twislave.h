@@ -0,0 +1,168 @@
+/*
+ * twislave.h
+ * 
+ * Interrupt based I2C slave emulating a register map.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#ifndef TWISLAVE_H_
+#define TWISLAVE_H_
+
+
+
+#include <stdbool.h>    //bool type
+#include <stdint.h>     //uint8_t type
+
+
+
+//own slave address (7-bit)
+#ifndef TWISLAVE_ADDRESS
+    #define TWISLAVE_ADDRESS 0x42
+#endif
+
+//number of registers (1-256), register numbers passed by the application
+//wrap around at TWISLAVE_REGS like the pointer of the host
+#ifndef TWISLAVE_REGS
+    #define TWISLAVE_REGS 32
+#endif
+
+//byte read by the host from write only registers
+#ifndef TWISLAVE_FILL
+    #define TWISLAVE_FILL 0xFF
+#endif
+
+/** Bytes of a register bitmap (change notification). */
+#define TWISLAVE_BITMAP_LEN ((TWISLAVE_REGS + 7) / 8)
+
+
+
+/**
+ * Access of the host to registers.
+ */
+typedef enum
+{
+    /** Host can read and write. */
+    TWISLAVE_RW,
+    /** Host can only read, writes are acknowledged and ignored. */
+    TWISLAVE_RO,
+    /** Host can only write, reads return TWISLAVE_FILL. */
+    TWISLAVE_WO
+} Twislave_access_t;
+
+
+
+/**
+ * Initializes the TWI hardware as slave with the address TWISLAVE_ADDRESS,
+ * all registers 0 and read/write.
+ * The host writes the register pointer as first byte of a write,
+ * following bytes are written to the registers, reads start at the
+ * pointer, both auto-increment the pointer
+ * (wrapping around at TWISLAVE_REGS),
+ * so the host can burst read the whole map.
+ * The interrupt routine only copies bytes from/to the map,
+ * so the clock is stretched as short as possible
+ * and never for the main loop.
+ * Uses the TWI interrupt, so twiint can't be used at the same time.
+ * Interrupts have to be enabled.
+ */
+void twislave_init(void);
+/**
+ * Sets the access of the host to a range of registers.
+ * 
+ * @param reg first register
+ * @param len number of registers (up to TWISLAVE_REGS, wrapping around)
+ * @param access access of the host
+ */
+void twislave_setAccess(uint8_t reg, uint16_t len, Twislave_access_t access);
+/**
+ * Returns true while the host is addressing the slave
+ * (between its address and the STOP).
+ * 
+ * @return if a host transaction is ongoing
+ */
+bool twislave_isBusy(void);
+
+/**
+ * Writes registers, regardless of their access,
+ * atomically with respect to the interrupt routine
+ * (a host burst read in progress might still see values of both sides,
+ * update outside of twislave_isBusy if that matters).
+ * 
+ * @param reg first register
+ * @param data location of the bytes to write
+ * @param len number of registers
+ */
+void twislave_write(uint8_t reg, const void *data, uint8_t len);
+/**
+ * Reads registers atomically with respect to the interrupt routine.
+ * 
+ * @param reg first register
+ * @param data location where the bytes should be written to
+ * @param len number of registers
+ */
+void twislave_read(uint8_t reg, void *data, uint8_t len);
+/**
+ * Writes a single register.
+ * 
+ * @param reg the register
+ * @param value new value of the register
+ */
+void twislave_set(uint8_t reg, uint8_t value);
+/**
+ * Reads a single register.
+ * 
+ * @param reg the register
+ * @return value of the register
+ */
+uint8_t twislave_get(uint8_t reg);
+
+/**
+ * Returns if the host wrote a register since the last call
+ * and clears its change bit.
+ * Changes become visible when the host transaction ends (STOP),
+ * so multi byte values are complete.
+ * 
+ * @param reg the register
+ * @return if the register was written by the host
+ */
+bool twislave_takeChange(uint8_t reg);
+/**
+ * Copies the change bitmap (bit reg%8 of byte reg/8 for register reg)
+ * and clears it.
+ * 
+ * @param bitmap location for the TWISLAVE_BITMAP_LEN bytes
+ * @return if any register was written by the host
+ */
+bool twislave_takeChanges(uint8_t *bitmap);
+
+
+
+#endif /* TWISLAVE_H_ */
@@ -54,6 +54,23 @@
     #define UARTINT_BUF_LEN 80
 #endif
 
+//uartint_transmitFlush sleeps in idle mode while waiting
+//unless UARTINT_NO_SLEEP is defined (busy waiting then)
+
+//wake-on-UART sleep (uartint_sleep) is available if UARTINT_WAKE is
+//defined (it occupies the pin change interrupt of port D, PCINT2_vect)
+#ifdef UARTINT_WAKE
+    //default to power-down, the lowest current,
+    //the oscillator start-up time swallows the first byte though,
+    //so the host has to precede commands with preamble bytes
+    #ifndef UARTINT_SLEEP_MODE
+        #define UARTINT_SLEEP_MODE SLEEP_MODE_PWR_DOWN
+        #ifndef UARTINT_PREAMBLE
+            #define UARTINT_PREAMBLE 0xFF
+        #endif
+    #endif
+#endif
+
 
 
 /** Stream that outputs to the UART. */
@@ -109,6 +126,9 @@ char *uartint_ngets(char *s, size_t len);
 size_t uartint_transmitAvailable(void);
 /**
  * Blocks until all bytes in the transmit buffer have been transmitted.
+ * The CPU sleeps in idle mode while waiting (unless UARTINT_NO_SLEEP),
+ * interrupts are enabled while waiting, the sleep mode
+ * and the interrupt flag are restored afterwards.
  */
 void uartint_transmitFlush(void);
 /**
@@ -130,6 +150,17 @@ bool uartint_transmit(uint8_t data);
  * (len on success)
  */
 size_t uartint_transmitBurst(uint8_t *data, size_t len);
+/**
+ * Adds multiple bytes to the transmit buffer without blocking.
+ * Either all bytes are added or, if there are not enough free locations
+ * in the transmit buffer, none at all, so records written with this function
+ * never get split up or interleaved on the line.
+ * 
+ * @param data location of the bytes that should be added to the buffer
+ * @param len number of bytes to add
+ * @return 0 if all bytes were added to the buffer, 1 otherwise
+ */
+bool uartint_transmitTry(uint8_t *data, size_t len);
 
 /**
  * Returns the number of bytes in the receive buffer available to be read.
@@ -161,6 +192,41 @@ bool uartint_receive(uint8_t *data);
  */
 size_t uartint_receiveBurst(uint8_t *data, size_t len);
 
+#ifdef UARTINT_WAKE
+/**
+ * Enters UARTINT_SLEEP_MODE (avr/sleep.h, default power-down) until
+ * activity on RXD (PD0, pin change interrupt) or any other interrupt
+ * wakes the CPU up again, but only if the receive buffer is empty.
+ * The transmit buffer is flushed completely before.
+ * Returns immediately if there are bytes to read,
+ * so it can be called whenever the receive buffer is drained, e.g.:
+ * 
+ * while(1)
+ *     if(uartint_ngets(s, 80))
+ *         doSomethingWithLine(s);
+ *     else
+ *         uartint_sleep();
+ * 
+ * Waking up from power-down takes the oscillator start-up time
+ * (up to 16K CK, 1ms at 16MHz), so the byte that woke the CPU is lost.
+ * If UARTINT_PREAMBLE is defined (default 0xFF in power-down),
+ * all bytes after waking up are discarded until UARTINT_PREAMBLE
+ * has been received, and the preamble bytes are discarded as well.
+ * The host then sends preamble bytes for at least the start-up time
+ * before each command. A preamble of 0xFF is ideal,
+ * its only falling edge is the start bit, so the USART can't
+ * misinterpret data bits as start bits after waking up.
+ * With UARTINT_SLEEP_MODE set to SLEEP_MODE_STANDBY the oscillator
+ * keeps running, the CPU wakes up within 6 cycles and catches
+ * the first byte already (no preamble needed, at a higher current).
+ * Any byte received with a framing error right after waking up
+ * is discarded. After a wake-up by another interrupt
+ * the receiver continues normally.
+ * Interrupts are enabled afterwards.
+ */
+void uartint_sleep(void);
+#endif
+
 
 
 #endif /* UARTINT_H_ */
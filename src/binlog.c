@@ -0,0 +1,90 @@
+/*
+ * binlog.c
+ * 
+ * Deferred binary logging over the buffered UART.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <string.h>         //memcpy
+#include <util/atomic.h>    //atomic blocks
+#include "uartint.h"        //transmit buffer
+#include "binlog.h"
+
+
+
+/** Number of dropped records. */
+static volatile uint16_t binlog_drops = 0;
+
+
+
+bool binlog_write(uint16_t id, uint8_t *args, size_t len)
+{
+    bool ret = 1;
+    uint8_t record[BINLOG_HEADER_LEN + BINLOG_ARGS_MAX];
+    
+    
+    if(len <= BINLOG_ARGS_MAX)
+    {
+        record[0] = id;
+        record[1] = id >> 8;
+        record[2] = len;
+        if(len)
+            memcpy(&record[BINLOG_HEADER_LEN], args, len);
+        
+        //the record is queued as a whole or not at all
+        ret = uartint_transmitTry(record, BINLOG_HEADER_LEN + len);
+    }
+    
+    if(ret)
+    {
+        //might be called from interrupts as well
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            if(binlog_drops < UINT16_MAX)
+                binlog_drops++;
+        }
+    }
+    
+    return ret;
+}
+
+uint16_t binlog_dropped(void)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = binlog_drops;
+        binlog_drops = 0;
+    }
+    
+    return ret;
+}
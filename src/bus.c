@@ -0,0 +1,170 @@
+/*
+ * bus.c
+ * 
+ * Bus manager, ownership arbitration of the SPI and TWI hardware
+ * between blocking users and the interrupt engines.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/interrupt.h>  //cli, sei
+#include <avr/sleep.h>      //idle sleep
+#include <stddef.h>         //NULL pointer
+#include <util/atomic.h>    //atomic blocks
+#include "bus.h"
+
+
+
+/** Current owners of the busses. */
+static volatile uint8_t bus_owners[BUS_N];
+/** Registered interrupt engines of the busses. */
+static const Bus_engine_t *bus_engines[BUS_N] = {NULL};
+
+
+
+void bus_setEngine(Bus_t bus, const Bus_engine_t *engine)
+{
+    bus_engines[bus] = engine;
+}
+
+
+
+/**
+ * Holds the queue of the interrupt engine of a bus.
+ * 
+ * @param bus bus whose engine to hold
+ */
+static void bus_lock(Bus_t bus)
+{
+    if(bus_engines[bus])
+        bus_engines[bus]->lock();
+}
+
+/**
+ * Lets the interrupt engine of a bus continue.
+ * 
+ * @param bus bus whose engine to continue
+ */
+static void bus_unlock(Bus_t bus)
+{
+    if(bus_engines[bus])
+        bus_engines[bus]->unlock();
+}
+
+/**
+ * Returns if the interrupt engine of a bus is currently transferring.
+ * 
+ * @param bus bus whose engine to check
+ * @return if the engine is running
+ */
+static bool bus_isRunning(Bus_t bus)
+{
+    return bus_engines[bus] && bus_engines[bus]->isRunning();
+}
+
+/**
+ * Sleeps until the next interrupt.
+ * Has to be called with interrupts disabled, returns with them disabled.
+ */
+static void bus_sleep(void)
+{
+    sleep_enable();
+    //the instruction after sei is executed before any interrupt,
+    //so no interrupt can sneak in between the check and sleeping
+    sei();
+    sleep_cpu();
+    sleep_disable();
+    cli();
+}
+
+
+
+//the functions could be exited from within the atomic blocks,
+//but the compiler doesn't know that and will throw a warning if done
+bool bus_tryAcquire(Bus_t bus, uint8_t owner)
+{
+    bool ret = 1;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(bus_owners[bus] == owner)
+        {
+            ret = 0;
+        }
+        else if(bus_owners[bus] == BUS_FREE && !bus_isRunning(bus))
+        {
+            bus_owners[bus] = owner;
+            bus_lock(bus);
+            ret = 0;
+        }
+    }
+    
+    return ret;
+}
+
+void bus_acquire(Bus_t bus, uint8_t owner)
+{
+    uint8_t sreg = SREG, smcr = SMCR;
+    
+    
+    set_sleep_mode(SLEEP_MODE_IDLE);
+    cli();
+    
+    //wait for the other owner
+    while(bus_owners[bus] != BUS_FREE && bus_owners[bus] != owner)
+        bus_sleep();
+    
+    //hold the queue, then wait for the running transfer only
+    bus_owners[bus] = owner;
+    bus_lock(bus);
+    while(bus_isRunning(bus))
+        bus_sleep();
+    
+    //leave the sleep mode and interrupt flag of the application
+    SMCR = smcr;
+    SREG = sreg;
+}
+
+void bus_release(Bus_t bus, uint8_t owner)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(bus_owners[bus] == owner)
+        {
+            bus_owners[bus] = BUS_FREE;
+            bus_unlock(bus);
+        }
+    }
+}
+
+uint8_t bus_owner(Bus_t bus)
+{
+    return bus_owners[bus];
+}
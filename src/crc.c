@@ -0,0 +1,95 @@
+/*
+ * crc.c
+ * 
+ * Table driven CRC-8/CRC-16 with the table generated at compile time
+ * and stored in program memory.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/pgmspace.h>   //PROGMEM
+#include "crc.h"
+
+
+
+/** CRC bit mask. */
+#define CRC_MASK ((1UL << CRC_WIDTH) - 1)
+/** One bit step of the bitwise CRC (multiplication by x modulo CRC_POLY). */
+#define CRC_STEP(c) \
+    ((((c) << 1) ^ ((((c) >> (CRC_WIDTH-1)) & 1) * CRC_POLY)) & CRC_MASK)
+#define CRC_STEP2(c) CRC_STEP(CRC_STEP(c))
+#define CRC_STEP4(c) CRC_STEP2(CRC_STEP2(c))
+#define CRC_STEP8(c) CRC_STEP4(CRC_STEP4(c))
+
+//the table is linear, every entry is the xor of the entries
+//of its single bits, the bases are evaluated once as enum constants
+//(split into bytes as int may only be 16 bit)
+/** Table entry of the single bit index 1 << k. */
+#define CRC_BASE(k) CRC_STEP8(1UL << ((k) + CRC_WIDTH - 8))
+enum
+{
+    CRC_B0L = CRC_BASE(0) & 0xFF, CRC_B0H = CRC_BASE(0) >> 8,
+    CRC_B1L = CRC_BASE(1) & 0xFF, CRC_B1H = CRC_BASE(1) >> 8,
+    CRC_B2L = CRC_BASE(2) & 0xFF, CRC_B2H = CRC_BASE(2) >> 8,
+    CRC_B3L = CRC_BASE(3) & 0xFF, CRC_B3H = CRC_BASE(3) >> 8,
+    CRC_B4L = CRC_BASE(4) & 0xFF, CRC_B4H = CRC_BASE(4) >> 8,
+    CRC_B5L = CRC_BASE(5) & 0xFF, CRC_B5H = CRC_BASE(5) >> 8,
+    CRC_B6L = CRC_BASE(6) & 0xFF, CRC_B6H = CRC_BASE(6) >> 8,
+    CRC_B7L = CRC_BASE(7) & 0xFF, CRC_B7H = CRC_BASE(7) >> 8
+};
+#define CRC_B(k) (((uint16_t)CRC_B##k##H << 8) | CRC_B##k##L)
+#define CRC_BIT(i, k) ((((i) >> k) & 1) ? CRC_B(k) : 0)
+
+/** Table entry i. */
+#define CRC_T(i) ((Crc_t)(CRC_BIT(i, 0) ^ CRC_BIT(i, 1) ^ CRC_BIT(i, 2) \
+    ^ CRC_BIT(i, 3) ^ CRC_BIT(i, 4) ^ CRC_BIT(i, 5) ^ CRC_BIT(i, 6) \
+    ^ CRC_BIT(i, 7)))
+#define CRC_T4(i) CRC_T(i), CRC_T((i)+1), CRC_T((i)+2), CRC_T((i)+3)
+#define CRC_T16(i) CRC_T4(i), CRC_T4((i)+4), CRC_T4((i)+8), CRC_T4((i)+12)
+#define CRC_T64(i) \
+    CRC_T16(i), CRC_T16((i)+16), CRC_T16((i)+32), CRC_T16((i)+48)
+
+const Crc_t crc_table[256] PROGMEM =
+    {CRC_T64(0), CRC_T64(64), CRC_T64(128), CRC_T64(192)};
+
+
+
+Crc_t crc_update(Crc_t crc, uint8_t data)
+{
+    return CRC_UPDATE(crc, data);
+}
+
+Crc_t crc_compute(Crc_t crc, const uint8_t *data, size_t len)
+{
+    while(len--)
+        crc = CRC_UPDATE(crc, *data++);
+    
+    return crc;
+}
@@ -0,0 +1,127 @@
+/*
+ * defer.c
+ * 
+ * Deferred call queue to move work out of interrupt routines.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <util/atomic.h>    //atomic blocks
+#include "defer.h"
+
+
+
+/** Queued call. */
+typedef struct
+{
+    Defer_t function;
+    void *arg;
+} Defer_call_t;
+
+
+
+/** Queued calls, one location stays free to tell full from empty. */
+static volatile Defer_call_t defer_calls[DEFER_N + 1];
+/** Next locations to write to and read from. */
+static volatile uint8_t defer_write = 0, defer_read = 0;
+/** Number of dropped calls. */
+static volatile uint8_t defer_drops = 0;
+
+
+
+bool defer_post(Defer_t function, void *arg)
+{
+    bool ret = 1;
+    uint8_t next;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        next = (defer_write + 1 > DEFER_N) ? 0 : defer_write + 1;
+        
+        if(next != defer_read)
+        {
+            defer_calls[defer_write].function = function;
+            defer_calls[defer_write].arg = arg;
+            defer_write = next;
+            ret = 0;
+        }
+        else if(defer_drops < UINT8_MAX)
+        {
+            defer_drops++;
+        }
+    }
+    
+    return ret;
+}
+
+size_t defer_dispatch(void)
+{
+    Defer_t function = NULL;
+    void *arg = NULL;
+    size_t n = 0;
+    bool empty;
+    
+    
+    while(1)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            empty = defer_read == defer_write;
+            if(!empty)
+            {
+                function = defer_calls[defer_read].function;
+                arg = defer_calls[defer_read].arg;
+                defer_read = (defer_read + 1 > DEFER_N) ? 0 : defer_read + 1;
+            }
+        }
+        
+        if(empty)
+            break;
+        
+        //called outside of the atomic block
+        function(arg);
+        n++;
+    }
+    
+    return n;
+}
+
+uint8_t defer_dropped(void)
+{
+    uint8_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = defer_drops;
+        defer_drops = 0;
+    }
+    
+    return ret;
+}
@@ -0,0 +1,347 @@
+/*
+ * expander.c
+ * 
+ * Write combining driver for I2C GPIO expanders (PCF8574, MCP23017)
+ * on twiint.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <util/atomic.h>    //atomic blocks
+#include "twiint.h"
+#include "expander.h"
+
+
+
+/** MCP23017 registers (IOCON.BANK = 0, A and B interleaved). */
+#define EXPANDER_IODIR      0x00
+#define EXPANDER_GPINTEN    0x04
+#define EXPANDER_IOCON      0x0A
+#define EXPANDER_GPPU       0x0C
+#define EXPANDER_GPIO       0x12
+#define EXPANDER_OLAT       0x14
+/** IOCON address with IOCON.BANK = 1 (GPINTENB with BANK = 0). */
+#define EXPANDER_IOCON_BANK1 0x05
+/** IOCON bit, INTA and INTB internally connected. */
+#define EXPANDER_MIRROR     0x40
+
+
+
+/** Initialized expanders. */
+static Expander_t *volatile expander_list = NULL;
+
+
+
+/**
+ * Queues the transaction of an expander.
+ * 
+ * @param expander pointer to the expander
+ * @param outLen number of bytes of outBuf to write
+ * @param inLen number of bytes to read into inBuf
+ */
+static void expander_submit(Expander_t *expander, size_t outLen,
+    size_t inLen);
+
+/**
+ * Transfers bytes with an expander, blocking.
+ * 
+ * @param expander pointer to the expander
+ * @param outLen number of bytes of outBuf to write
+ * @param inLen number of bytes to read into inBuf
+ * @return 0 on success, 1 on failure
+ */
+static bool expander_transfer(Expander_t *expander, size_t outLen,
+    size_t inLen)
+{
+    expander_submit(expander, outLen, inLen);
+    while(expander->transaction.status == TWIINT_BUSY)
+        ;
+    
+    return expander->transaction.status != TWIINT_OK;
+}
+
+/**
+ * Writes a register pair of a MCP23017, blocking.
+ * 
+ * @param expander pointer to the expander
+ * @param reg register of port A
+ * @param value value of port A (low byte) and B (high byte)
+ * @return 0 on success, 1 on failure
+ */
+static bool expander_writePair(Expander_t *expander, uint8_t reg,
+    uint16_t value)
+{
+    expander->outBuf[0] = reg;
+    expander->outBuf[1] = value & 0xFF;
+    expander->outBuf[2] = value >> 8;
+    return expander_transfer(expander, 3, 0);
+}
+
+
+
+bool expander_init(Expander_t *expander, Expander_type_t type,
+    uint8_t address, uint16_t inputs, uint16_t window, uint16_t readPeriod)
+{
+    expander->transaction = TWIINT_INIT(address, NULL, 0, NULL, 0);
+    expander->type = type;
+    expander->address = address;
+    expander->inputs = inputs;
+    expander->output = expander->input = 0;
+    expander->dirty = expander->readPending = false;
+    expander->window = expander->windowCountdown = window;
+    expander->readPeriod = expander->readCountdown = readPeriod;
+    expander->errors = 0;
+    
+    if(type == EXPANDER_MCP23017)
+    {
+        //BANK is unknown after a MCU-only reset, clear it through IOCON's
+        //BANK = 1 address first (with BANK = 0 this hits GPINTENB,
+        //which is rewritten below), then write IOCON at its BANK = 0 address
+        expander->outBuf[0] = EXPANDER_IOCON_BANK1;
+        expander->outBuf[1] = EXPANDER_MIRROR;
+        if(expander_transfer(expander, 2, 0))
+            return 1;
+        expander->outBuf[0] = EXPANDER_IOCON;
+        expander->outBuf[1] = EXPANDER_MIRROR;
+        if(expander_transfer(expander, 2, 0)
+                || expander_writePair(expander, EXPANDER_OLAT, 0)
+                || expander_writePair(expander, EXPANDER_IODIR, inputs)
+                || expander_writePair(expander, EXPANDER_GPPU, inputs)
+                || expander_writePair(expander, EXPANDER_GPINTEN, inputs))
+            return 1;
+        
+        expander->outBuf[0] = EXPANDER_GPIO;
+        if(expander_transfer(expander, 1, 2))
+            return 1;
+        expander->input = expander->inBuf[0] | (expander->inBuf[1] << 8);
+    }
+    else
+    {
+        //inputs are pins written high (weak pull-up)
+        expander->outBuf[0] = inputs & 0xFF;
+        if(expander_transfer(expander, 1, 0)
+                || expander_transfer(expander, 0, 1))
+            return 1;
+        expander->input = expander->inBuf[0];
+    }
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        expander->next = expander_list;
+        expander_list = expander;
+    }
+    
+    return 0;
+}
+
+
+
+/**
+ * Takes over the result of a transaction, called when it completed.
+ * 
+ * @param transaction transaction of the expander
+ */
+static void expander_done(Twiint_t *transaction)
+{
+    //the transaction is the first member of the expander
+    Expander_t *expander = (Expander_t*)transaction;
+    
+    
+    if(transaction->status != TWIINT_OK)
+    {
+        expander->errors++;
+        //write again on the next tick, read again on the next request
+        if(!transaction->inLen)
+        {
+            expander->dirty = true;
+            expander->windowCountdown = 0;
+        }
+        return;
+    }
+    
+    if(transaction->inLen)
+    {
+        if(expander->type == EXPANDER_MCP23017)
+            expander->input = expander->inBuf[0]
+                | (expander->inBuf[1] << 8);
+        else
+            expander->input = expander->inBuf[0];
+    }
+}
+
+static void expander_submit(Expander_t *expander, size_t outLen,
+    size_t inLen)
+{
+    expander->transaction = twiint_initTransaction(expander->address,
+        expander->outBuf, outLen, expander->inBuf, inLen);
+    twiint_setTransactionCallback(&expander->transaction, expander_done,
+        false);
+    twiint_submit(&expander->transaction);
+}
+
+
+
+void expander_tick(void)
+{
+    Expander_t *e;
+    uint16_t output;
+    
+    
+    for(e=expander_list; e; e=e->next)
+    {
+        if(e->readPeriod && !--e->readCountdown)
+        {
+            e->readCountdown = e->readPeriod;
+            e->readPending = true;
+        }
+        if(e->windowCountdown)
+            e->windowCountdown--;
+        
+        //one transaction at a time, the buffers are shared
+        if(e->transaction.status == TWIINT_BUSY)
+            continue;
+        
+        if(e->dirty && !e->windowCountdown)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                output = e->output;
+                e->dirty = false;
+            }
+            
+            if(e->type == EXPANDER_MCP23017)
+            {
+                e->outBuf[0] = EXPANDER_OLAT;
+                e->outBuf[1] = output & 0xFF;
+                e->outBuf[2] = output >> 8;
+                expander_submit(e, 3, 0);
+            }
+            else
+            {
+                e->outBuf[0] = (output | e->inputs) & 0xFF;
+                expander_submit(e, 1, 0);
+            }
+        }
+        else if(e->readPending)
+        {
+            e->readPending = false;
+            
+            if(e->type == EXPANDER_MCP23017)
+            {
+                //reading GPIO also clears the interrupt
+                e->outBuf[0] = EXPANDER_GPIO;
+                expander_submit(e, 1, 2);
+            }
+            else
+            {
+                expander_submit(e, 0, 1);
+            }
+        }
+    }
+}
+
+void expander_interrupt(Expander_t *expander)
+{
+    expander->readPending = true;
+}
+
+bool expander_isBusy(const Expander_t *expander)
+{
+    return expander->dirty || expander->transaction.status == TWIINT_BUSY;
+}
+
+
+
+void expander_set(Expander_t *expander, uint8_t pin, bool value)
+{
+    expander_write(expander, (value) ? 0xFFFF : 0x0000,
+        (uint16_t)1 << pin);
+}
+
+void expander_toggle(Expander_t *expander, uint8_t pin)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        expander_write(expander, ~expander->output, (uint16_t)1 << pin);
+    }
+}
+
+void expander_write(Expander_t *expander, uint16_t value, uint16_t mask)
+{
+    uint16_t output;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        output = (expander->output & ~mask) | (value & mask);
+        
+        //unchanged outputs cause no traffic,
+        //the window starts with the first change
+        if(output != expander->output)
+        {
+            expander->output = output;
+            if(!expander->dirty)
+            {
+                expander->dirty = true;
+                expander->windowCountdown = expander->window;
+            }
+        }
+    }
+}
+
+bool expander_getOutput(const Expander_t *expander, uint8_t pin)
+{
+    bool ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = expander->output & ((uint16_t)1 << pin);
+    }
+    
+    return ret;
+}
+
+
+
+bool expander_get(const Expander_t *expander, uint8_t pin)
+{
+    return expander_read(expander) & ((uint16_t)1 << pin);
+}
+
+uint16_t expander_read(const Expander_t *expander)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = expander->input;
+    }
+    
+    return ret;
+}
@@ -0,0 +1,576 @@
+/*
+ * mcp2515.c
+ * 
+ * MCP2515 CAN controller driver on spiint
+ * (interrupt driven receive queue, transmit mailboxes).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/io.h>         //hardware registers
+#include <avr/interrupt.h>  //interrupt vectors
+#include <util/atomic.h>    //atomic blocks
+#include "spiint.h"
+#include "mcp2515.h"
+
+
+
+//bit timing, sync + propagation + phase 1 segments up to the sample
+//point at 75%, the SJW is 1 time quantum
+#if MCP2515_OSC % (2 * 16 * MCP2515_BITRATE) == 0
+    #define MCP2515_TQ 16
+    #define MCP2515_PROP 3
+    #define MCP2515_PS1 8
+    #define MCP2515_PS2 4
+#elif MCP2515_OSC % (2 * 8 * MCP2515_BITRATE) == 0
+    #define MCP2515_TQ 8
+    #define MCP2515_PROP 2
+    #define MCP2515_PS1 3
+    #define MCP2515_PS2 2
+#else
+    #error "MCP2515_BITRATE not reachable with MCP2515_OSC!"
+#endif
+
+#define MCP2515_BRP (MCP2515_OSC / (2 * MCP2515_TQ * MCP2515_BITRATE) - 1)
+#if MCP2515_BRP > 63
+    #error "MCP2515_BITRATE too low!"
+#endif
+
+#define MCP2515_CNF1_VALUE MCP2515_BRP
+#define MCP2515_CNF2_VALUE (0x80 | ((MCP2515_PS1 - 1) << 3) \
+    | (MCP2515_PROP - 1))
+#define MCP2515_CNF3_VALUE (MCP2515_PS2 - 1)
+
+
+#if MCP2515_INT == 0
+    #define MCP2515_INTx INT0
+    #define MCP2515_ISCx0 ISC00
+    #define MCP2515_ISCx1 ISC01
+    #define MCP2515_INT_vect INT0_vect
+    #define MCP2515_INT_PORT PORTD
+    #define MCP2515_INT_DDR DDRD
+    #define MCP2515_INT_BIT PORTD2
+#elif MCP2515_INT == 1
+    #define MCP2515_INTx INT1
+    #define MCP2515_ISCx0 ISC10
+    #define MCP2515_ISCx1 ISC11
+    #define MCP2515_INT_vect INT1_vect
+    #define MCP2515_INT_PORT PORTD
+    #define MCP2515_INT_DDR DDRD
+    #define MCP2515_INT_BIT PORTD3
+#else
+    #error "No valid MCP2515_INT selected!"
+#endif
+
+
+/** Instructions. */
+#define MCP2515_RESET       0xC0
+#define MCP2515_READ        0x03
+#define MCP2515_WRITE       0x02
+#define MCP2515_BIT_MODIFY  0x05
+#define MCP2515_READ_RX     0x90    //| (n << 2), from RXBnSIDH
+#define MCP2515_LOAD_TX     0x40    //| (n << 1), from TXBnSIDH
+#define MCP2515_RTS         0x80    //| (1 << n)
+
+/** Registers. */
+#define MCP2515_CANSTAT     0x0E
+#define MCP2515_CANCTRL     0x0F
+#define MCP2515_CNF3        0x28    //followed by CNF2, CNF1 & CANINTE
+#define MCP2515_CANINTF     0x2C    //followed by EFLG
+#define MCP2515_EFLG        0x2D
+#define MCP2515_RXB0CTRL    0x60
+
+/** Operation modes (CANCTRL REQOP, CANSTAT OPMOD). */
+#define MCP2515_MODE_MASK   0xE0
+#define MCP2515_MODE_NORMAL 0x00
+#define MCP2515_MODE_CONFIG 0x80
+
+/** CANINTE/CANINTF bits. */
+#define MCP2515_RX0IF       0x01
+#define MCP2515_RX1IF       0x02
+#define MCP2515_TXIF        0x1C    //TX0IF - TX2IF
+#define MCP2515_ERRIF       0x20
+/** EFLG bits. */
+#define MCP2515_RX0OVR      0x40
+#define MCP2515_RX1OVR      0x80
+/** RXB0CTRL rollover bit. */
+#define MCP2515_BUKT        0x04
+/** SIDL bits. */
+#define MCP2515_SRR         0x10
+#define MCP2515_EXIDE       0x08
+/** DLC remote transmission request bit. */
+#define MCP2515_RTR         0x40
+
+/** Bytes of a frame in the buffer registers (SIDH, SIDL, EID8, EID0,
+ * DLC and 8 data bytes). */
+#define MCP2515_FRAME_LEN 13
+/** Status reads until a requested mode is reached. */
+#define MCP2515_MODE_TRIES 10000
+
+
+
+/** The MCP2515. */
+static const Spi_device_t *mcp2515_device;
+
+/** Receive queue, frames in buffer register format. */
+static uint8_t mcp2515_rxFrames[MCP2515_RX_FRAMES][MCP2515_FRAME_LEN];
+/** Next frame to write and to read. */
+static volatile uint8_t mcp2515_rxHead = 0, mcp2515_rxTail = 0;
+/** Head after the running interrupt service. */
+static uint8_t mcp2515_rxNext = 0;
+/** Mailboxes with a frame not sent yet. */
+static volatile uint8_t mcp2515_txBusy = 0;
+/** Drop and overrun counters. */
+static volatile uint16_t mcp2515_droppedCount = 0, mcp2515_overrunCount = 0;
+
+/** Interrupt service transaction buffers. */
+static uint8_t mcp2515_flagsOut[4] = {MCP2515_READ, MCP2515_CANINTF};
+static uint8_t mcp2515_flagsIn[4];
+static uint8_t mcp2515_rxOut[2] = {MCP2515_READ_RX | (0 << 2),
+    MCP2515_READ_RX | (1 << 2)};
+static uint8_t mcp2515_clearOut[2][4];
+/** Interrupt service transactions. */
+static Spiint_t mcp2515_flags, mcp2515_rxCmd[2], mcp2515_rxData[2],
+    mcp2515_clear[2];
+
+/** Mailbox transaction buffers. */
+static uint8_t mcp2515_loadOut[MCP2515_MAILBOXES][1 + MCP2515_FRAME_LEN];
+static uint8_t mcp2515_rtsOut[MCP2515_MAILBOXES] = {MCP2515_RTS | (1 << 0),
+    MCP2515_RTS | (1 << 1), MCP2515_RTS | (1 << 2)};
+/** Mailbox transactions. */
+static Spiint_t mcp2515_load[MCP2515_MAILBOXES] = {{.done = true},
+    {.done = true}, {.done = true}},
+    mcp2515_rts[MCP2515_MAILBOXES] = {{.done = true}, {.done = true},
+    {.done = true}};
+
+/** Blocking transaction. */
+static Spiint_t mcp2515_control;
+
+
+
+/**
+ * Transfers bytes to/from the MCP2515, blocking.
+ * 
+ * @param out location of the bytes to shift out
+ * @param in location where the shifted in bytes should be written to
+ * or NULL
+ * @param len number of bytes
+ */
+static void mcp2515_transfer(uint8_t *out, uint8_t *in, size_t len)
+{
+    mcp2515_control = spiint_initDeviceTransaction(mcp2515_device,
+        out, in, len);
+    spiint_submit(&mcp2515_control);
+    while(!mcp2515_control.done);
+}
+
+/**
+ * Reads a register, blocking.
+ * 
+ * @param address address of the register
+ * @return value of the register
+ */
+static uint8_t mcp2515_readRegister(uint8_t address)
+{
+    uint8_t buf[3] = {MCP2515_READ, address};
+    
+    mcp2515_transfer(buf, buf, sizeof(buf));
+    return buf[2];
+}
+
+/**
+ * Changes bits of a register, blocking.
+ * 
+ * @param address address of the register
+ * @param mask bits to change
+ * @param value new values of the bits
+ */
+static void mcp2515_modifyRegister(uint8_t address, uint8_t mask,
+    uint8_t value)
+{
+    uint8_t buf[4] = {MCP2515_BIT_MODIFY, address, mask, value};
+    
+    mcp2515_transfer(buf, NULL, sizeof(buf));
+}
+
+/**
+ * Waits until the MCP2515 reached an operation mode.
+ * 
+ * @param mode the operation mode
+ * @return 0 on success, 1 if the mode wasn't reached
+ */
+static bool mcp2515_waitMode(uint8_t mode)
+{
+    uint16_t i;
+    
+    for(i=0; i<MCP2515_MODE_TRIES; i++)
+        if((mcp2515_readRegister(MCP2515_CANSTAT) & MCP2515_MODE_MASK)
+                == mode)
+            return 0;
+    
+    return 1;
+}
+
+/**
+ * Requests an operation mode and waits until it is reached.
+ * 
+ * @param mode the operation mode
+ * @return 0 on success, 1 if the mode wasn't reached
+ */
+static bool mcp2515_setMode(uint8_t mode)
+{
+    mcp2515_modifyRegister(MCP2515_CANCTRL, MCP2515_MODE_MASK, mode);
+    return mcp2515_waitMode(mode);
+}
+
+/**
+ * Writes an identifier in register format (SIDH, SIDL, EID8, EID0).
+ * 
+ * @param regs location of the 4 registers
+ * @param id the identifier
+ * @param extended if the identifier is an extended one
+ */
+static void mcp2515_encodeId(uint8_t *regs, uint32_t id, bool extended)
+{
+    if(extended)
+    {
+        regs[0] = id >> 21;
+        regs[1] = (((id >> 18) & 0x07) << 5) | MCP2515_EXIDE
+            | ((id >> 16) & 0x03);
+        regs[2] = id >> 8;
+        regs[3] = id;
+    }
+    else
+    {
+        regs[0] = id >> 3;
+        regs[1] = (id & 0x07) << 5;
+        regs[2] = regs[3] = 0;
+    }
+}
+
+/**
+ * Writes 4 identifier registers (mask or filter), in configuration mode.
+ * 
+ * @param address address of the SIDH register
+ * @param id the identifier
+ * @param extended if the identifier is an extended one
+ * @return 0 on success, 1 if the mode couldn't be changed
+ */
+static bool mcp2515_writeId(uint8_t address, uint32_t id, bool extended)
+{
+    uint8_t buf[6] = {MCP2515_WRITE, address};
+    
+    
+    mcp2515_encodeId(buf + 2, id, extended);
+    
+    if(mcp2515_setMode(MCP2515_MODE_CONFIG))
+        return 1;
+    mcp2515_transfer(buf, NULL, sizeof(buf));
+    return mcp2515_setMode(MCP2515_MODE_NORMAL);
+}
+
+
+
+bool mcp2515_init(const Spi_device_t *device)
+{
+    uint8_t buf[6];
+    
+    
+    EIMSK &= ~(1 << MCP2515_INTx);
+    mcp2515_device = device;
+    mcp2515_rxHead = mcp2515_rxTail = mcp2515_rxNext = 0;
+    mcp2515_txBusy = 0;
+    mcp2515_droppedCount = mcp2515_overrunCount = 0;
+    
+    //the MCP2515 enters configuration mode after its oscillator started
+    buf[0] = MCP2515_RESET;
+    mcp2515_transfer(buf, NULL, 1);
+    if(mcp2515_waitMode(MCP2515_MODE_CONFIG))
+        return 1;
+    
+    buf[0] = MCP2515_WRITE;
+    buf[1] = MCP2515_CNF3;
+    buf[2] = MCP2515_CNF3_VALUE;
+    buf[3] = MCP2515_CNF2_VALUE;
+    buf[4] = MCP2515_CNF1_VALUE;
+    //all receive & transmit interrupts and errors (overruns)
+    buf[5] = MCP2515_RX0IF | MCP2515_RX1IF | MCP2515_TXIF | MCP2515_ERRIF;
+    mcp2515_transfer(buf, NULL, 6);
+    
+    //the masks are cleared by the reset, so all frames are received
+    mcp2515_modifyRegister(MCP2515_RXB0CTRL, MCP2515_BUKT, MCP2515_BUKT);
+    
+    if(mcp2515_setMode(MCP2515_MODE_NORMAL))
+        return 1;
+    
+    //INT is an open drain output, low while flags are set
+    MCP2515_INT_DDR &= ~(1 << MCP2515_INT_BIT);
+    MCP2515_INT_PORT |= (1 << MCP2515_INT_BIT);
+    EICRA &= ~((1 << MCP2515_ISCx1) | (1 << MCP2515_ISCx0));
+    EIMSK |= (1 << MCP2515_INTx);
+    
+    return 0;
+}
+
+
+
+bool mcp2515_setMask(uint8_t mask, uint32_t id, bool extended)
+{
+    return mcp2515_writeId(0x20 + 4*mask, id, extended);
+}
+
+bool mcp2515_setFilter(uint8_t filter, uint32_t id, bool extended)
+{
+    //RXF0-2 at 0x00, RXF3-5 at 0x10
+    return mcp2515_writeId(4*filter + ((filter >= 3) ? 4 : 0), id, extended);
+}
+
+
+
+bool mcp2515_transmit(uint8_t mailbox, const Mcp2515_frame_t *frame)
+{
+    uint8_t *buf, len, i;
+    
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(mailbox == MCP2515_ANY)
+            for(mailbox=0; mailbox<MCP2515_MAILBOXES; mailbox++)
+                if(!(mcp2515_txBusy & (1 << mailbox)))
+                    break;
+        if(mailbox >= MCP2515_MAILBOXES
+                || (mcp2515_txBusy & (1 << mailbox))
+                || !mcp2515_rts[mailbox].done)
+            return 1;
+        mcp2515_txBusy |= (1 << mailbox);
+    }
+    
+    len = (frame->len > 8) ? 8 : frame->len;
+    buf = mcp2515_loadOut[mailbox];
+    buf[0] = MCP2515_LOAD_TX | (mailbox << 1);
+    mcp2515_encodeId(buf + 1, frame->id, frame->extended);
+    buf[5] = len | ((frame->rtr) ? MCP2515_RTR : 0);
+    for(i=0; i<len; i++)
+        buf[6 + i] = frame->data[i];
+    
+    mcp2515_load[mailbox] = spiint_initDeviceTransaction(mcp2515_device,
+        buf, NULL, 6 + len);
+    mcp2515_rts[mailbox] = spiint_initDeviceTransaction(mcp2515_device,
+        &mcp2515_rtsOut[mailbox], NULL, 1);
+    spiint_submit(&mcp2515_load[mailbox]);
+    spiint_submit(&mcp2515_rts[mailbox]);
+    
+    return 0;
+}
+
+bool mcp2515_isPending(uint8_t mailbox)
+{
+    return mcp2515_txBusy & (1 << mailbox);
+}
+
+
+
+uint8_t mcp2515_available(void)
+{
+    uint8_t head = mcp2515_rxHead, tail = mcp2515_rxTail;
+    
+    return (head >= tail) ? head - tail : MCP2515_RX_FRAMES - tail + head;
+}
+
+bool mcp2515_receive(Mcp2515_frame_t *frame)
+{
+    uint8_t *buf, i;
+    
+    
+    if(mcp2515_rxHead == mcp2515_rxTail)
+        return 1;
+    
+    buf = mcp2515_rxFrames[mcp2515_rxTail];
+    frame->extended = buf[1] & MCP2515_EXIDE;
+    if(frame->extended)
+    {
+        frame->id = ((uint32_t)buf[0] << 21)
+            | ((uint32_t)(buf[1] >> 5) << 18)
+            | ((uint32_t)(buf[1] & 0x03) << 16)
+            | ((uint16_t)buf[2] << 8) | buf[3];
+        frame->rtr = buf[4] & MCP2515_RTR;
+    }
+    else
+    {
+        frame->id = ((uint16_t)buf[0] << 3) | (buf[1] >> 5);
+        frame->rtr = buf[1] & MCP2515_SRR;
+    }
+    frame->len = buf[4] & 0x0F;
+    if(frame->len > 8)
+        frame->len = 8;
+    for(i=0; i<frame->len; i++)
+        frame->data[i] = buf[5 + i];
+    
+    mcp2515_rxTail = (mcp2515_rxTail + 1) % MCP2515_RX_FRAMES;
+    return 0;
+}
+
+
+
+uint16_t mcp2515_dropped(void)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = mcp2515_droppedCount;
+    }
+    
+    return ret;
+}
+
+uint16_t mcp2515_overruns(void)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = mcp2515_overrunCount;
+    }
+    
+    return ret;
+}
+
+
+
+/**
+ * Completes the interrupt service, the received frames are queued
+ * and the flags are cleared, called by the last transaction.
+ * 
+ * @param transaction the last transaction of the service
+ */
+static void mcp2515_serviceDone(Spiint_t *transaction)
+{
+    (void)transaction;  //suppress unused warning
+    mcp2515_rxHead = mcp2515_rxNext;
+    //fires again right away if new flags were set in the meantime
+    EIMSK |= (1 << MCP2515_INTx);
+}
+
+/**
+ * Reads the received frames and clears the other flags,
+ * called when the flags were read.
+ * 
+ * @param transaction the flags transaction
+ */
+static void mcp2515_service(Spiint_t *transaction)
+{
+    Spiint_t *queue[6];
+    uint8_t intf = mcp2515_flagsIn[2], eflg = mcp2515_flagsIn[3];
+    uint8_t n = 0, next = mcp2515_rxHead, i;
+    uint8_t *in;
+    
+    
+    (void)transaction;  //suppress unused warning
+    
+    //READ RX BUFFER clears the flag when SS rises,
+    //read straight into the queue, RXB0 first as it is older
+    for(i=0; i<2; i++)
+    {
+        if(!(intf & (MCP2515_RX0IF << i)))
+            continue;
+        
+        if((next + 1) % MCP2515_RX_FRAMES != mcp2515_rxTail)
+        {
+            in = mcp2515_rxFrames[next];
+            next = (next + 1) % MCP2515_RX_FRAMES;
+        }
+        else
+        {
+            in = NULL;
+            mcp2515_droppedCount++;
+        }
+        
+        mcp2515_rxCmd[i] = spiint_initDeviceTransaction(mcp2515_device,
+            &mcp2515_rxOut[i], NULL, 1);
+        mcp2515_rxCmd[i].hold = true;
+        mcp2515_rxData[i] = spiint_initDeviceTransaction(mcp2515_device,
+            NULL, in, MCP2515_FRAME_LEN);
+        mcp2515_rxData[i].config = NULL;
+        queue[n++] = &mcp2515_rxCmd[i];
+        queue[n++] = &mcp2515_rxData[i];
+    }
+    
+    //transmit complete frees the mailboxes
+    intf &= ~(MCP2515_RX0IF | MCP2515_RX1IF);
+    if(intf)
+    {
+        mcp2515_txBusy &= ~((intf & MCP2515_TXIF) >> 2);
+        mcp2515_clearOut[0][0] = MCP2515_BIT_MODIFY;
+        mcp2515_clearOut[0][1] = MCP2515_CANINTF;
+        mcp2515_clearOut[0][2] = intf;
+        mcp2515_clearOut[0][3] = 0x00;
+        mcp2515_clear[0] = spiint_initDeviceTransaction(mcp2515_device,
+            mcp2515_clearOut[0], NULL, 4);
+        queue[n++] = &mcp2515_clear[0];
+    }
+    
+    if(eflg & (MCP2515_RX0OVR | MCP2515_RX1OVR))
+    {
+        mcp2515_overrunCount += !!(eflg & MCP2515_RX0OVR)
+            + !!(eflg & MCP2515_RX1OVR);
+        mcp2515_clearOut[1][0] = MCP2515_BIT_MODIFY;
+        mcp2515_clearOut[1][1] = MCP2515_EFLG;
+        mcp2515_clearOut[1][2] = MCP2515_RX0OVR | MCP2515_RX1OVR;
+        mcp2515_clearOut[1][3] = 0x00;
+        mcp2515_clear[1] = spiint_initDeviceTransaction(mcp2515_device,
+            mcp2515_clearOut[1], NULL, 4);
+        queue[n++] = &mcp2515_clear[1];
+    }
+    
+    mcp2515_rxNext = next;
+    if(!n)
+    {
+        mcp2515_serviceDone(NULL);
+        return;
+    }
+    
+    spiint_setCallback(queue[n-1], mcp2515_serviceDone, false);
+    for(i=0; i<n; i++)
+        spiint_submit(queue[i]);
+}
+
+
+
+ISR(MCP2515_INT_vect)
+{
+    //masked until the flags are serviced, as the INT line stays low
+    EIMSK &= ~(1 << MCP2515_INTx);
+    
+    mcp2515_flags = spiint_initDeviceTransaction(mcp2515_device,
+        mcp2515_flagsOut, mcp2515_flagsIn, sizeof(mcp2515_flagsIn));
+    spiint_setCallback(&mcp2515_flags, mcp2515_service, false);
+    spiint_submit(&mcp2515_flags);
+}
@@ -0,0 +1,160 @@
+/*
+ * mspim.c
+ * 
+ * Minimalistic, blocking SPI master on the USART (MSPIM).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/io.h>
+#include "mspim.h"
+
+
+
+//default to Arduino oscillator
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+    #warning "F_CPU not defined! Assuming 16MHz."
+#endif
+
+
+//datasheet table 20-1, f = F_CPU/(2*(UBRR+1)),
+//round UBRR up so that the frequency won't be above MSPIM_FREQUENCY
+#define MSPIM_UBRR_VALUE \
+    ((F_CPU + 2*MSPIM_FREQUENCY - 1) / (2*MSPIM_FREQUENCY) - 1)
+#if MSPIM_UBRR_VALUE > 4095
+    #error "MSPIM_FREQUENCY too low!"
+#endif
+
+#if MSPIM_MODE == 0
+    #define UCPOL_VALUE 0
+    #define UCPHA_VALUE 0
+#elif MSPIM_MODE == 1
+    #define UCPOL_VALUE 0
+    #define UCPHA_VALUE 1
+#elif MSPIM_MODE == 2
+    #define UCPOL_VALUE 1
+    #define UCPHA_VALUE 0
+#elif MSPIM_MODE == 3
+    #define UCPOL_VALUE 1
+    #define UCPHA_VALUE 1
+#else
+    #error "No valid MSPIM_MODE defined!"
+#endif
+
+#if MSPIM_DORD == 0
+    #define UDORD_VALUE 0
+#elif MSPIM_DORD == 1
+    #define UDORD_VALUE 1
+#else
+    #error "No valid MSPIM_DORD defined!"
+#endif
+
+
+
+void mspim_init(void)
+{
+    //the baud rate has to be zero when the transmitter is enabled
+    UBRR0 = 0;
+    //XCK
+    DDRD |= (1 << DDD4);
+    
+    UCSR0C = (1 << UMSEL01) | (1 << UMSEL00) | (UDORD_VALUE << UDORD0)
+        | (UCPHA_VALUE << UCPHA0) | (UCPOL_VALUE << UCPOL0);
+    UCSR0B = (1 << RXEN0) | (1 << TXEN0);
+    UBRR0 = MSPIM_UBRR_VALUE;
+}
+
+
+
+uint8_t mspim_writeRead(uint8_t data)
+{
+    while(~UCSR0A & (1 << UDRE0))
+        ;
+    UDR0 = data;
+    while(~UCSR0A & (1 << RXC0))
+        ;
+    
+    return UDR0;
+}
+
+/**
+ * Shifts out/in multiple bytes, keeping the transmit buffer filled.
+ * At most two bytes (shift register and transmit buffer) are in flight,
+ * so the two level receive buffer can't overflow.
+ * 
+ * @param out location of the bytes to shift out or NULL for fill
+ * @param in location for the shifted in bytes or NULL to discard them
+ * @param len number of bytes to shift out/in
+ * @param fill byte to shift out if out is NULL
+ */
+static void mspim_burst(uint8_t *out, uint8_t *in, size_t len, uint8_t fill)
+{
+    size_t tx = len, rx = len;
+    uint8_t data;
+    
+    
+    while(rx)
+    {
+        if(tx && rx-tx < 2 && (UCSR0A & (1 << UDRE0)))
+        {
+            UDR0 = (out) ? *out++ : fill;
+            tx--;
+        }
+        
+        if(UCSR0A & (1 << RXC0))
+        {
+            data = UDR0;
+            if(in)
+                *in++ = data;
+            rx--;
+        }
+    }
+}
+
+void mspim_writeBurst(uint8_t *out, size_t len)
+{
+    mspim_burst(out, NULL, len, 0x00);
+}
+
+void mspim_readBurst(uint8_t *in, size_t len)
+{
+    mspim_burst(NULL, in, len, 0x00);
+}
+
+void mspim_readBurstFill(uint8_t *in, size_t len, uint8_t fill)
+{
+    mspim_burst(NULL, in, len, fill);
+}
+
+void mspim_writeReadBurst(uint8_t *out, uint8_t *in, size_t len)
+{
+    mspim_burst(out, in, len, 0x00);
+}
@@ -0,0 +1,277 @@
+/*
+ * mspimint.c
+ * 
+ * Queued, interrupt based SPI master on the USART (MSPIM).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>  //interrupt vectors
+#include <util/atomic.h>    //atomic blocks
+#include "defer.h"          //deferred callbacks
+#include "mspimint.h"
+
+
+
+//default to Arduino oscillator
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+    #warning "F_CPU not defined! Assuming 16MHz."
+#endif
+
+
+//datasheet table 20-1, f = F_CPU/(2*(UBRR+1)),
+//round UBRR up so that the frequency won't be above MSPIM_FREQUENCY
+#define MSPIM_UBRR_VALUE \
+    ((F_CPU + 2*MSPIM_FREQUENCY - 1) / (2*MSPIM_FREQUENCY) - 1)
+#if MSPIM_UBRR_VALUE > 4095
+    #error "MSPIM_FREQUENCY too low!"
+#endif
+
+#if MSPIM_MODE == 0
+    #define UCPOL_VALUE 0
+    #define UCPHA_VALUE 0
+#elif MSPIM_MODE == 1
+    #define UCPOL_VALUE 0
+    #define UCPHA_VALUE 1
+#elif MSPIM_MODE == 2
+    #define UCPOL_VALUE 1
+    #define UCPHA_VALUE 0
+#elif MSPIM_MODE == 3
+    #define UCPOL_VALUE 1
+    #define UCPHA_VALUE 1
+#else
+    #error "No valid MSPIM_MODE defined!"
+#endif
+
+#if MSPIM_DORD == 0
+    #define UDORD_VALUE 0
+#elif MSPIM_DORD == 1
+    #define UDORD_VALUE 1
+#else
+    #error "No valid MSPIM_DORD defined!"
+#endif
+
+
+
+/** Location of the byte that will be shifted out next. */
+static volatile uint8_t *mspimint_out;
+/** Location where the next shifted in byte will be written to. */
+static volatile uint8_t *mspimint_in;
+/** Number of bytes left to shift out. */
+static volatile size_t mspimint_txLen;
+/** Number of bytes left to shift in. */
+static volatile size_t mspimint_rxLen;
+/** Byte to shift out if there is no out location. */
+static volatile uint8_t mspimint_fill;
+
+/** Queued transactions, the head is the one currently running. */
+static Mspimint_t *volatile mspimint_head = NULL,
+    *volatile mspimint_tail = NULL;
+/** Transaction used by mspimint_transmitBurst. */
+static Mspimint_t mspimint_burst = {.done = true};
+
+
+
+void mspimint_init(void)
+{
+    //the baud rate has to be zero when the transmitter is enabled
+    UBRR0 = 0;
+    //XCK
+    DDRD |= (1 << DDD4);
+    
+    UCSR0C = (1 << UMSEL01) | (1 << UMSEL00) | (UDORD_VALUE << UDORD0)
+        | (UCPHA_VALUE << UCPHA0) | (UCPOL_VALUE << UCPOL0);
+    UCSR0B = (1 << RXCIE0) | (1 << RXEN0) | (1 << TXEN0);
+    UBRR0 = MSPIM_UBRR_VALUE;
+}
+
+Mspimint_t mspimint_initTransaction(uint8_t *out, uint8_t *in, size_t len,
+    volatile uint8_t *port, uint8_t pin)
+{
+    return MSPIMINT_INIT(out, in, len, port, pin);
+}
+
+
+
+bool mspimint_isBusy(void)
+{
+    return mspimint_head;
+}
+
+void mspimint_flush(void)
+{
+    while(mspimint_head)
+        ;
+}
+
+
+
+/** Calls the callback of a transaction, deferred version. */
+static void mspimint_dispatch(void *transaction)
+{
+    ((Mspimint_t*)transaction)->callback(transaction);
+}
+
+/**
+ * Calls the callback of a completed transaction, if any,
+ * directly or deferred.
+ */
+static void mspimint_notify(Mspimint_t *t)
+{
+    if(t->callback)
+    {
+        if(t->deferred)
+            defer_post(mspimint_dispatch, t);
+        else
+            t->callback(t);
+    }
+}
+
+/**
+ * Starts the transaction at the head of the queue, if any.
+ * Has to be called with interrupts disabled.
+ */
+static void mspimint_start(void)
+{
+    Mspimint_t *t = mspimint_head;
+    
+    if(!t)
+    {
+        mspimint_tail = NULL;
+        return;
+    }
+    
+    mspimint_out = t->out;
+    mspimint_in = t->in;
+    mspimint_txLen = mspimint_rxLen = t->len;
+    mspimint_fill = t->fill;
+    
+    //pull SS low only if provided
+    if(t->port)
+        *t->port &= ~(1 << t->pin);
+    
+    //start transmission, the transmit buffer is empty
+    UCSR0B |= (1 << UDRIE0);
+}
+
+void mspimint_submit(Mspimint_t *transaction)
+{
+    transaction->done = false;
+    transaction->next = NULL;
+    
+    //nothing to shift, complete right away
+    if(!transaction->len)
+    {
+        transaction->done = true;
+        mspimint_notify(transaction);
+        return;
+    }
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(mspimint_head)
+        {
+            mspimint_tail->next = transaction;
+            mspimint_tail = transaction;
+        }
+        else
+        {
+            mspimint_head = mspimint_tail = transaction;
+            mspimint_start();
+        }
+    }
+}
+
+void mspimint_setFill(Mspimint_t *transaction, uint8_t fill)
+{
+    transaction->fill = fill;
+}
+
+void mspimint_setCallback(Mspimint_t *transaction,
+    void (*callback)(Mspimint_t *transaction), bool deferred)
+{
+    transaction->callback = callback;
+    transaction->deferred = deferred;
+}
+
+void mspimint_transmitBurst(uint8_t *out, uint8_t *in, size_t len,
+    uint8_t *port, uint8_t pin)
+{
+    //block if the last burst is still going
+    while(!mspimint_burst.done)
+        ;
+    
+    mspimint_burst = mspimint_initTransaction(out, in, len, port, pin);
+    mspimint_submit(&mspimint_burst);
+}
+
+
+
+ISR(USART_UDRE_vect)
+{
+    if(mspimint_out)
+        UDR0 = *mspimint_out++;
+    else
+        UDR0 = mspimint_fill;
+    
+    //everything written, the receive interrupt completes the transaction
+    if(!--mspimint_txLen)
+        UCSR0B &= ~(1 << UDRIE0);
+}
+
+ISR(USART_RX_vect)
+{
+    Mspimint_t *t;
+    uint8_t data = UDR0;
+    
+    
+    //save shifted in byte
+    if(mspimint_in)
+        *mspimint_in++ = data;
+    
+    //continue if not done
+    if(--mspimint_rxLen)
+        return;
+    
+    //stop if done
+    t = mspimint_head;
+    if(t->port)
+        *t->port |= (1 << t->pin);
+    t->done = true;
+    
+    //chain the next transaction
+    mspimint_head = t->next;
+    mspimint_start();
+    
+    //notify after the bus is busy again
+    mspimint_notify(t);
+}
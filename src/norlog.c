@@ -0,0 +1,487 @@
+/*
+ * norlog.c
+ * 
+ * Append only log store for SPI NOR flash (W25Qxx) on spiint.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <string.h>         //memcpy
+#include <util/atomic.h>    //atomic blocks
+#include "spiint.h"
+#include "norlog.h"
+
+
+
+/** Flash instructions. */
+#define NORLOG_WRITE_ENABLE     0x06
+#define NORLOG_READ_STATUS      0x05
+#define NORLOG_PAGE_PROGRAM     0x02
+#define NORLOG_SECTOR_ERASE     0x20
+#define NORLOG_READ_DATA        0x03
+/** Status register busy bit. */
+#define NORLOG_BUSY 0x01
+
+/** Pages of a 4K erase sector. */
+#define NORLOG_SECTOR_PAGES 16
+/** First log page, the first sector holds the log header. */
+#define NORLOG_FIRST NORLOG_SECTOR_PAGES
+/** Epoch of erased flash, never used for a log. */
+#define NORLOG_ERASED 0xFFFF
+/** Magic following the header of the log header page. */
+#define NORLOG_MAGIC "NORLOG"
+#define NORLOG_MAGIC_LEN (sizeof(NORLOG_MAGIC) - 1)
+
+/** States of the background engine. */
+#define NORLOG_IDLE     0
+#define NORLOG_PROGRAM  1
+#define NORLOG_ERASE    2
+
+
+
+/** The flash. */
+static const Spi_device_t *norlog_device;
+/** Epoch of the current log, stored in every page header. */
+static uint16_t norlog_epoch = NORLOG_ERASED;
+/** Next page to program and end of the erased pages ahead of it. */
+static uint16_t norlog_head = NORLOG_PAGES, norlog_erased = NORLOG_PAGES;
+
+/** Page buffers, header followed by the payload. */
+static uint8_t norlog_buffers[2][NORLOG_PAGE_LEN];
+/** Next buffer to program, number of filled buffers
+ * and bytes of the buffer filling. */
+static uint8_t norlog_programBuf = 0, norlog_readyCount = 0,
+    norlog_fillLen = 0;
+/** Bytes dropped by norlog_write. */
+static uint32_t norlog_droppedBytes = 0;
+
+/** State of the background engine. */
+static uint8_t norlog_state = NORLOG_IDLE;
+/** If the status was read since the operation was started. */
+static bool norlog_polled = false;
+/** If the last queued transaction keeps the SS low. */
+static bool norlog_holding = false;
+
+/** Transaction buffers. */
+static uint8_t norlog_enableOut[1] = {NORLOG_WRITE_ENABLE};
+static uint8_t norlog_statusOut[2] = {NORLOG_READ_STATUS, 0x00};
+static uint8_t norlog_statusIn[2];
+static uint8_t norlog_cmdOut[4];
+/** Transactions, done while not queued. */
+static Spiint_t norlog_enable = {.done = true}, norlog_status = {.done = true},
+    norlog_cmd = {.done = true}, norlog_data = {.done = true};
+
+
+
+/**
+ * Queues a transaction to the flash.
+ * A transaction following one that held the SS keeps the configuration
+ * so the frame isn't disturbed.
+ * 
+ * @param t transaction to use
+ * @param out location of the bytes to shift out or NULL
+ * @param in location where the shifted in bytes should be written to
+ * or NULL
+ * @param len number of bytes
+ * @param hold if the SS should be kept low for a following transaction
+ */
+static void norlog_queue(Spiint_t *t, uint8_t *out, uint8_t *in,
+    size_t len, bool hold)
+{
+    *t = spiint_initDeviceTransaction(norlog_device, out, in, len);
+    if(norlog_holding)
+        t->config = NULL;
+    t->hold = hold;
+    norlog_holding = hold;
+    spiint_submit(t);
+}
+
+/**
+ * Queues a write enable followed by an instruction with a page address.
+ * 
+ * @param instruction instruction to send
+ * @param page address of the page
+ * @param hold if data follows in the same frame
+ */
+static void norlog_command(uint8_t instruction, uint16_t page, bool hold)
+{
+    if(instruction != NORLOG_READ_DATA)
+        norlog_queue(&norlog_enable, norlog_enableOut, NULL, 1, false);
+    
+    norlog_cmdOut[0] = instruction;
+    norlog_cmdOut[1] = page >> 8;
+    norlog_cmdOut[2] = page & 0xFF;
+    norlog_cmdOut[3] = 0x00;
+    norlog_queue(&norlog_cmd, norlog_cmdOut, NULL, 4, hold);
+}
+
+/**
+ * Blocks until a transaction is completed.
+ * 
+ * @param t transaction to wait for
+ */
+static void norlog_wait(Spiint_t *t)
+{
+    while(!t->done);
+}
+
+/**
+ * Blocks until the flash completed programming/erasing.
+ */
+static void norlog_waitReady(void)
+{
+    do
+    {
+        norlog_queue(&norlog_status, norlog_statusOut, norlog_statusIn, 2,
+            false);
+        norlog_wait(&norlog_status);
+    } while(norlog_statusIn[1] & NORLOG_BUSY);
+}
+
+/**
+ * Reads the header and optionally the payload of a page, blocking.
+ * 
+ * @param page page to read
+ * @param header location for the NORLOG_HEADER_LEN header bytes
+ * @param payload location for the payload bytes or NULL
+ * @param len number of payload bytes to read
+ */
+static void norlog_read(uint16_t page, uint8_t *header, uint8_t *payload,
+    size_t len)
+{
+    //keep the frame together
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        norlog_command(NORLOG_READ_DATA, page, true);
+        norlog_queue(&norlog_status, NULL, header, NORLOG_HEADER_LEN,
+            payload != NULL);
+        if(payload)
+            norlog_queue(&norlog_data, NULL, payload, len, false);
+    }
+    norlog_wait((payload) ? &norlog_data : &norlog_status);
+}
+
+/**
+ * Returns the epoch of a page header.
+ * 
+ * @param header the header
+ * @return the epoch
+ */
+static uint16_t norlog_headerEpoch(const uint8_t *header)
+{
+    return header[0] | ((uint16_t)header[1] << 8);
+}
+
+/**
+ * Writes a page header into a buffer.
+ * 
+ * @param buffer the page buffer
+ * @param used number of used payload bytes
+ */
+static void norlog_setHeader(uint8_t *buffer, uint8_t used)
+{
+    buffer[0] = norlog_epoch & 0xFF;
+    buffer[1] = norlog_epoch >> 8;
+    buffer[2] = used;
+}
+
+
+/**
+ * Advances a running operation, polling the flash until it completed.
+ * 
+ * @return true if the operation is still running
+ */
+static bool norlog_poll(void)
+{
+    //the last queued transaction of an operation completes last
+    if(!norlog_cmd.done || !norlog_data.done || !norlog_status.done)
+        return true;
+    if(norlog_state == NORLOG_IDLE)
+        return false;
+    
+    if(!norlog_polled || (norlog_statusIn[1] & NORLOG_BUSY))
+    {
+        norlog_queue(&norlog_status, norlog_statusOut, norlog_statusIn, 2,
+            false);
+        norlog_polled = true;
+        return true;
+    }
+    
+    if(norlog_state == NORLOG_PROGRAM)
+    {
+        norlog_head++;
+        norlog_programBuf ^= 1;
+        norlog_readyCount--;
+    }
+    else
+    {
+        norlog_erased += NORLOG_SECTOR_PAGES;
+    }
+    norlog_state = NORLOG_IDLE;
+    norlog_polled = false;
+    return false;
+}
+
+
+
+bool norlog_init(const Spi_device_t *device)
+{
+    uint8_t header[NORLOG_HEADER_LEN], magic[NORLOG_MAGIC_LEN];
+    uint16_t low, high, mid;
+    
+    
+    norlog_device = device;
+    norlog_state = NORLOG_IDLE;
+    norlog_polled = norlog_holding = false;
+    norlog_programBuf = norlog_readyCount = norlog_fillLen = 0;
+    norlog_droppedBytes = 0;
+    
+    //nothing is programmed without a log
+    norlog_epoch = NORLOG_ERASED;
+    norlog_head = norlog_erased = NORLOG_PAGES;
+    
+    norlog_waitReady();
+    norlog_read(0, header, magic, NORLOG_MAGIC_LEN);
+    if(norlog_headerEpoch(header) == NORLOG_ERASED
+            || memcmp(magic, NORLOG_MAGIC, NORLOG_MAGIC_LEN))
+        return 1;
+    norlog_epoch = norlog_headerEpoch(header);
+    
+    //the programmed pages of this epoch form a prefix of the log
+    low = NORLOG_FIRST;
+    high = NORLOG_PAGES;
+    while(low < high)
+    {
+        mid = low + (high - low)/2;
+        norlog_read(mid, header, NULL, 0);
+        if(norlog_headerEpoch(header) == norlog_epoch)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    norlog_head = low;
+    
+    //a partially programmed sector was erased in this epoch
+    if(norlog_head % NORLOG_SECTOR_PAGES)
+        norlog_erased = norlog_head - norlog_head % NORLOG_SECTOR_PAGES
+            + NORLOG_SECTOR_PAGES;
+    else
+        norlog_erased = norlog_head;
+    
+    return 0;
+}
+
+/**
+ * Returns an epoch above every epoch on the flash, blocking.
+ * The first page of a sector is always programmed first,
+ * so the sector headers (and the log header) hold every used epoch.
+ * 
+ * @return the new epoch, NORLOG_ERASED if every epoch is used up
+ */
+static uint16_t norlog_newEpoch(void)
+{
+    uint8_t header[NORLOG_HEADER_LEN];
+    uint16_t page, epoch, max = 0;
+    bool found = false;
+    
+    
+    for(page=0; page<NORLOG_PAGES; page+=NORLOG_SECTOR_PAGES)
+    {
+        norlog_read(page, header, NULL, 0);
+        epoch = norlog_headerEpoch(header);
+        if(epoch != NORLOG_ERASED && (!found || epoch > max))
+        {
+            max = epoch;
+            found = true;
+        }
+    }
+    
+    return (found) ? max + 1 : 0;
+}
+
+void norlog_format(void)
+{
+    uint8_t *buffer = norlog_buffers[0];
+    uint16_t page;
+    
+    
+    //complete a running operation, discard the buffers
+    while(norlog_poll());
+    norlog_programBuf = norlog_readyCount = norlog_fillLen = 0;
+    
+    //a stale page of the new epoch would break the prefix of the log,
+    //even without a valid log header (fresh flash or interrupted format)
+    norlog_epoch = norlog_newEpoch();
+    if(norlog_epoch == NORLOG_ERASED)
+    {
+        //every epoch used up, start over on an erased log
+        for(page=NORLOG_FIRST; page<NORLOG_PAGES; page+=NORLOG_SECTOR_PAGES)
+        {
+            norlog_command(NORLOG_SECTOR_ERASE, page, false);
+            norlog_waitReady();
+        }
+        norlog_epoch = 0;
+    }
+    
+    norlog_command(NORLOG_SECTOR_ERASE, 0, false);
+    norlog_waitReady();
+    
+    norlog_setHeader(buffer, 0);
+    memcpy(buffer + NORLOG_HEADER_LEN, NORLOG_MAGIC, NORLOG_MAGIC_LEN);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        norlog_command(NORLOG_PAGE_PROGRAM, 0, true);
+        norlog_queue(&norlog_data, buffer,
+            NULL, NORLOG_HEADER_LEN + NORLOG_MAGIC_LEN, false);
+    }
+    norlog_waitReady();
+    
+    norlog_head = norlog_erased = NORLOG_FIRST;
+}
+
+
+
+void norlog_tick(void)
+{
+    uint8_t *buffer;
+    
+    
+    if(norlog_poll())
+        return;
+    
+    if(norlog_readyCount && norlog_head < norlog_erased)
+    {
+        //the command and the page in one frame, without copying
+        buffer = norlog_buffers[norlog_programBuf];
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            norlog_command(NORLOG_PAGE_PROGRAM, norlog_head, true);
+            norlog_queue(&norlog_data, buffer, NULL,
+                NORLOG_HEADER_LEN + buffer[2], false);
+        }
+        norlog_state = NORLOG_PROGRAM;
+    }
+    else if(norlog_erased < NORLOG_PAGES
+        && norlog_erased - norlog_head < NORLOG_SECTOR_PAGES)
+    {
+        //keep the next sector erased while the pages fill
+        norlog_command(NORLOG_SECTOR_ERASE, norlog_erased, false);
+        norlog_state = NORLOG_ERASE;
+    }
+}
+
+bool norlog_isBusy(void)
+{
+    return norlog_state != NORLOG_IDLE
+        || (norlog_readyCount && norlog_head < NORLOG_PAGES);
+}
+
+
+
+size_t norlog_write(const void *data, size_t len)
+{
+    const uint8_t *bytes = data;
+    uint8_t *buffer;
+    size_t n, written = 0;
+    
+    
+    while(len)
+    {
+        //both buffers full or no space left on the flash
+        if(norlog_readyCount >= 2
+                || norlog_head + norlog_readyCount >= NORLOG_PAGES)
+            break;
+        
+        buffer = norlog_buffers[(norlog_programBuf + norlog_readyCount) & 1];
+        n = NORLOG_PAYLOAD_LEN - norlog_fillLen;
+        if(n > len)
+            n = len;
+        memcpy(buffer + NORLOG_HEADER_LEN + norlog_fillLen, bytes, n);
+        
+        norlog_fillLen += n;
+        bytes += n;
+        len -= n;
+        written += n;
+        if(norlog_fillLen >= NORLOG_PAYLOAD_LEN)
+            norlog_flush();
+    }
+    
+    norlog_droppedBytes += len;
+    return written;
+}
+
+void norlog_flush(void)
+{
+    if(!norlog_fillLen)
+        return;
+    
+    norlog_setHeader(
+        norlog_buffers[(norlog_programBuf + norlog_readyCount) & 1],
+        norlog_fillLen);
+    norlog_readyCount++;
+    norlog_fillLen = 0;
+}
+
+void norlog_sync(void)
+{
+    norlog_flush();
+    while(norlog_isBusy())
+        norlog_tick();
+}
+
+
+
+uint16_t norlog_pages(void)
+{
+    return (norlog_epoch == NORLOG_ERASED) ? 0 : norlog_head - NORLOG_FIRST;
+}
+
+uint8_t norlog_readPage(uint16_t page, uint8_t *data)
+{
+    uint8_t header[NORLOG_HEADER_LEN];
+    
+    
+    if(page >= norlog_pages())
+        return 0;
+    
+    //the flash can't be read while it is busy
+    while(norlog_poll());
+    
+    norlog_read(NORLOG_FIRST + page, header, data, NORLOG_PAYLOAD_LEN);
+    if(norlog_headerEpoch(header) != norlog_epoch
+            || header[2] > NORLOG_PAYLOAD_LEN)
+        return 0;
+    return header[2];
+}
+
+uint32_t norlog_dropped(void)
+{
+    return norlog_droppedBytes;
+}
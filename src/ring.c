@@ -103,6 +103,26 @@ bool ring_pushOver(Ring_t *ring, uint8_t data)
     return 0;
 }
 
+bool ring_pushBurst(Ring_t *ring, uint8_t *data, size_t len)
+{
+    uint8_t *write = ring->write;
+    
+    //cancel if not everything fits
+    if(ring_pushAvailable(*ring) < len)
+        return 1;
+    
+    //work on a local copy of the write pointer
+    //and only publish it when all elements are in place
+    while(len--)
+    {
+        *write = *data++;
+        write = RING_INC_ROLL_OVER(write, ring->buf, ring->end);
+    }
+    ring->write = write;
+    
+    return 0;
+}
+
 
 bool ring_pop(Ring_t *ring, uint8_t *data)
 {
@@ -0,0 +1,507 @@
+/*
+ * sd.c
+ * 
+ * SD/MMC card block driver over SPI with multi-block transfers
+ * and a write-back sector cache.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <string.h>     //memcpy
+#include "spi.h"
+#include "sd.h"
+
+
+
+//commands, ACMDs are sent after CMD55
+#define SD_CMD0     (0)         //GO_IDLE_STATE
+#define SD_CMD1     (1)         //SEND_OP_COND (MMC)
+#define SD_CMD8     (8)         //SEND_IF_COND
+#define SD_CMD12    (12)        //STOP_TRANSMISSION
+#define SD_CMD16    (16)        //SET_BLOCKLEN
+#define SD_CMD17    (17)        //READ_SINGLE_BLOCK
+#define SD_CMD18    (18)        //READ_MULTIPLE_BLOCK
+#define SD_ACMD23   (0x80 | 23) //SET_WR_BLK_ERASE_COUNT
+#define SD_CMD24    (24)        //WRITE_BLOCK
+#define SD_CMD25    (25)        //WRITE_MULTIPLE_BLOCK
+#define SD_ACMD41   (0x80 | 41) //SD_SEND_OP_COND
+#define SD_CMD55    (55)        //APP_CMD
+#define SD_CMD58    (58)        //READ_OCR
+
+//data tokens
+#define SD_TOKEN_START          0xFE
+#define SD_TOKEN_START_MULTI    0xFC
+#define SD_TOKEN_STOP_MULTI     0xFD
+
+
+
+/** Card (configuration and CS). */
+static Spi_device_t sd_device;
+/** Type of the initialized card. */
+static Sd_type_t sd_cardType = SD_NONE;
+
+#if SD_CACHE_SECTORS
+/**
+ * Cached sector.
+ */
+typedef struct
+{
+    /** Number of the sector. */
+    uint32_t sector;
+    /** Value of sd_cacheClock at the last access. */
+    uint16_t used;
+    /** If the sector holds valid data. */
+    bool valid;
+    /** If the sector has been changed and has to be written back. */
+    bool dirty;
+    /** Content of the sector. */
+    uint8_t data[SD_SECTOR_LEN];
+} Sd_cache_t;
+
+/** Cached sectors. */
+static Sd_cache_t sd_caches[SD_CACHE_SECTORS];
+/** Access counter for the least recently used eviction. */
+static uint16_t sd_cacheClock = 0;
+#endif
+
+
+
+/**
+ * Shifts in a byte while sending 0xFF.
+ * 
+ * @return the shifted in byte
+ */
+static uint8_t sd_receive(void)
+{
+    return spi_writeRead(0xFF);
+}
+
+/**
+ * Waits until the card isn't busy anymore (MISO high).
+ * 
+ * @return 0 if the card is ready, 1 on timeout
+ */
+static bool sd_waitReady(void)
+{
+    uint32_t i;
+    
+    for(i=0; i<SD_TIMEOUT; i++)
+        if(sd_receive() == 0xFF)
+            return 0;
+    
+    return 1;
+}
+
+/**
+ * Raises CS and sends another byte so the card releases MISO.
+ */
+static void sd_deselect(void)
+{
+    spi_deselect(&sd_device);
+    sd_receive();
+}
+
+/**
+ * Selects the card (applying its SPI configuration) and sends a command.
+ * 
+ * @param cmd command number, 0x80 set for ACMDs
+ * @param arg argument
+ * @return R1 response, 0xFF on timeout
+ */
+static uint8_t sd_command(uint8_t cmd, uint32_t arg)
+{
+    uint8_t frame[6], r1, i;
+    
+    
+    if(cmd & 0x80)
+    {
+        cmd &= 0x7F;
+        r1 = sd_command(SD_CMD55, 0);
+        if(r1 > 1)
+            return r1;
+    }
+    
+    //CMD12 interrupts a running read, the card is busy sending data
+    if(cmd != SD_CMD12)
+    {
+        sd_deselect();
+        spi_select(&sd_device);
+        if(cmd != SD_CMD0 && sd_waitReady())
+            return 0xFF;
+    }
+    
+    frame[0] = 0x40 | cmd;
+    frame[1] = arg >> 24;
+    frame[2] = arg >> 16;
+    frame[3] = arg >> 8;
+    frame[4] = arg;
+    //only CMD0 and CMD8 need a valid CRC in SPI mode
+    if(cmd == SD_CMD0)
+        frame[5] = 0x95;
+    else if(cmd == SD_CMD8)
+        frame[5] = 0x87;
+    else
+        frame[5] = 0x01;
+    spi_writeBurst(frame, sizeof(frame));
+    
+    //skip the stuff byte
+    if(cmd == SD_CMD12)
+        sd_receive();
+    
+    //the response follows within 8 bytes
+    for(i=0, r1=0xFF; i<10 && (r1 & 0x80); i++)
+        r1 = sd_receive();
+    
+    return r1;
+}
+
+/**
+ * Receives a data block.
+ * 
+ * @param data location for the SD_SECTOR_LEN bytes
+ * @return 0 if the block was received, 1 otherwise
+ */
+static bool sd_receiveBlock(uint8_t *data)
+{
+    uint32_t i;
+    uint8_t token = 0xFF;
+    
+    
+    for(i=0; i<SD_TIMEOUT && token == 0xFF; i++)
+        token = sd_receive();
+    if(token != SD_TOKEN_START)
+        return 1;
+    
+    spi_readBurstFill(data, SD_SECTOR_LEN, 0xFF);
+    //CRC
+    sd_receive();
+    sd_receive();
+    
+    return 0;
+}
+
+/**
+ * Transmits a data block or the stop token.
+ * 
+ * @param data location of the SD_SECTOR_LEN bytes
+ * @param token start token or the stop token (no data)
+ * @return 0 if the block was accepted, 1 otherwise
+ */
+static bool sd_transmitBlock(uint8_t *data, uint8_t token)
+{
+    if(sd_waitReady())
+        return 1;
+    
+    spi_writeRead(token);
+    if(token == SD_TOKEN_STOP_MULTI)
+        return 0;
+    
+    spi_writeBurst(data, SD_SECTOR_LEN);
+    //CRC
+    sd_receive();
+    sd_receive();
+    
+    //data response xxx0sss1, sss = 010 accepted
+    return (sd_receive() & 0x1F) != 0x05;
+}
+
+/**
+ * Converts a sector number into a command argument.
+ * 
+ * @param sector number of the sector
+ * @return block or byte address
+ */
+static uint32_t sd_address(uint32_t sector)
+{
+    return (sd_cardType == SD_V2HC) ? sector : sector * SD_SECTOR_LEN;
+}
+
+
+
+bool sd_init(volatile uint8_t *port, uint8_t pin)
+{
+    uint8_t ocr[4], cmd;
+    uint16_t i;
+    
+    
+    sd_device = spi_initDevice(SD_INIT_FREQUENCY, 0, 0, port, pin);
+    sd_cardType = SD_NONE;
+    #if SD_CACHE_SECTORS
+        for(i=0; i<SD_CACHE_SECTORS; i++)
+            sd_caches[i].valid = sd_caches[i].dirty = false;
+    #endif
+    
+    //at least 74 clocks with CS high
+    spi_deselect(&sd_device);
+    spi_setConfig(sd_device.config);
+    for(i=0; i<10; i++)
+        sd_receive();
+    
+    if(sd_command(SD_CMD0, 0) == 1)
+    {
+        if(sd_command(SD_CMD8, 0x1AA) == 1)
+        {
+            //version 2, check the echoed voltage range and pattern
+            spi_readBurstFill(ocr, sizeof(ocr), 0xFF);
+            if(ocr[2] == 0x01 && ocr[3] == 0xAA)
+            {
+                //HCS, the host supports high capacity
+                for(i=0; i<SD_INIT_TRIES
+                        && sd_command(SD_ACMD41, 1UL << 30); i++)
+                    ;
+                
+                if(i < SD_INIT_TRIES && !sd_command(SD_CMD58, 0))
+                {
+                    spi_readBurstFill(ocr, sizeof(ocr), 0xFF);
+                    //CCS, block addressed
+                    sd_cardType = (ocr[0] & 0x40) ? SD_V2HC : SD_V2;
+                }
+            }
+        }
+        else
+        {
+            //version 1 or MMC
+            if(sd_command(SD_ACMD41, 0) <= 1)
+            {
+                sd_cardType = SD_V1;
+                cmd = SD_ACMD41;
+            }
+            else
+            {
+                sd_cardType = SD_MMC;
+                cmd = SD_CMD1;
+            }
+            
+            for(i=0; i<SD_INIT_TRIES && sd_command(cmd, 0); i++)
+                ;
+            
+            if(i == SD_INIT_TRIES || sd_command(SD_CMD16, SD_SECTOR_LEN))
+                sd_cardType = SD_NONE;
+        }
+    }
+    
+    sd_deselect();
+    
+    //fast clock from now on
+    if(sd_cardType != SD_NONE)
+        sd_device.config = spi_initConfig(SD_FREQUENCY, 0, 0);
+    
+    return sd_cardType == SD_NONE;
+}
+
+Sd_type_t sd_type(void)
+{
+    return sd_cardType;
+}
+
+
+
+/**
+ * Reads sectors from the card, bypassing the cache.
+ */
+static bool sd_readSectors(uint32_t sector, uint8_t *data, size_t count)
+{
+    bool ret = 1;
+    
+    
+    if(count == 1)
+    {
+        ret = sd_command(SD_CMD17, sd_address(sector))
+            || sd_receiveBlock(data);
+    }
+    else if(!sd_command(SD_CMD18, sd_address(sector)))
+    {
+        while(count && !sd_receiveBlock(data))
+        {
+            data += SD_SECTOR_LEN;
+            count--;
+        }
+        ret = count;
+        
+        sd_command(SD_CMD12, 0);
+    }
+    
+    sd_deselect();
+    return ret;
+}
+
+/**
+ * Writes sectors to the card, bypassing the cache.
+ */
+static bool sd_writeSectors(uint32_t sector, uint8_t *data, size_t count)
+{
+    bool ret = 1;
+    
+    
+    if(count == 1)
+    {
+        ret = sd_command(SD_CMD24, sd_address(sector))
+            || sd_transmitBlock(data, SD_TOKEN_START);
+    }
+    else
+    {
+        if(sd_cardType != SD_MMC)
+            sd_command(SD_ACMD23, count);
+        
+        if(!sd_command(SD_CMD25, sd_address(sector)))
+        {
+            while(count && !sd_transmitBlock(data, SD_TOKEN_START_MULTI))
+            {
+                data += SD_SECTOR_LEN;
+                count--;
+            }
+            
+            ret = sd_transmitBlock(NULL, SD_TOKEN_STOP_MULTI) || count;
+        }
+    }
+    
+    //wait until the data is programmed
+    if(sd_waitReady())
+        ret = 1;
+    
+    sd_deselect();
+    return ret;
+}
+
+bool sd_read(uint32_t sector, uint8_t *data, size_t count)
+{
+    #if SD_CACHE_SECTORS
+        uint8_t i;
+    #endif
+    
+    
+    if(sd_cardType == SD_NONE)
+        return 1;
+    if(!count)
+        return 0;
+    
+    if(sd_readSectors(sector, data, count))
+        return 1;
+    
+    #if SD_CACHE_SECTORS
+        //the cached copies might be newer
+        for(i=0; i<SD_CACHE_SECTORS; i++)
+            if(sd_caches[i].valid && sd_caches[i].sector - sector < count)
+                memcpy(data + (sd_caches[i].sector-sector)*SD_SECTOR_LEN,
+                    sd_caches[i].data, SD_SECTOR_LEN);
+    #endif
+    
+    return 0;
+}
+
+bool sd_write(uint32_t sector, uint8_t *data, size_t count)
+{
+    #if SD_CACHE_SECTORS
+        uint8_t i;
+    #endif
+    
+    
+    if(sd_cardType == SD_NONE)
+        return 1;
+    if(!count)
+        return 0;
+    
+    #if SD_CACHE_SECTORS
+        //the cached copies are outdated now
+        for(i=0; i<SD_CACHE_SECTORS; i++)
+            if(sd_caches[i].valid && sd_caches[i].sector - sector < count)
+                sd_caches[i].valid = sd_caches[i].dirty = false;
+    #endif
+    
+    return sd_writeSectors(sector, data, count);
+}
+
+
+
+#if SD_CACHE_SECTORS
+uint8_t *sd_cache(uint32_t sector, bool write)
+{
+    Sd_cache_t *c = NULL;
+    uint8_t i;
+    
+    
+    if(sd_cardType == SD_NONE)
+        return NULL;
+    
+    //hit, otherwise the first invalid or least recently used one
+    for(i=0; i<SD_CACHE_SECTORS; i++)
+    {
+        if(sd_caches[i].valid && sd_caches[i].sector == sector)
+        {
+            c = &sd_caches[i];
+            break;
+        }
+        
+        if(!c || (c->valid && (!sd_caches[i].valid
+                || (uint16_t)(sd_cacheClock - sd_caches[i].used)
+                > (uint16_t)(sd_cacheClock - c->used))))
+            c = &sd_caches[i];
+    }
+    
+    if(!c->valid || c->sector != sector)
+    {
+        if(c->valid && c->dirty
+                && sd_writeSectors(c->sector, c->data, 1))
+            return NULL;
+        
+        c->valid = c->dirty = false;
+        if(sd_readSectors(sector, c->data, 1))
+            return NULL;
+        c->sector = sector;
+        c->valid = true;
+    }
+    
+    c->used = sd_cacheClock++;
+    if(write)
+        c->dirty = true;
+    
+    return c->data;
+}
+
+bool sd_sync(void)
+{
+    bool ret = 0;
+    uint8_t i;
+    
+    
+    for(i=0; i<SD_CACHE_SECTORS; i++)
+    {
+        if(sd_caches[i].valid && sd_caches[i].dirty)
+        {
+            if(sd_writeSectors(sd_caches[i].sector, sd_caches[i].data, 1))
+                ret = 1;
+            else
+                sd_caches[i].dirty = false;
+        }
+    }
+    
+    return ret;
+}
+#endif
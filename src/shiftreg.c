@@ -0,0 +1,187 @@
+/*
+ * shiftreg.c
+ * 
+ * Background refresh engine for daisy chained 74HC595 output
+ * and 74HC165 input shift registers on spiint.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/io.h>
+#include <util/atomic.h>    //atomic blocks
+#include "spiint.h"
+#include "shiftreg.h"
+
+
+
+/** Bytes per refresh, both chains are shifted at once. */
+#if SHIFTREG_OUT_LEN > SHIFTREG_IN_LEN
+    #define SHIFTREG_LEN SHIFTREG_OUT_LEN
+#else
+    #define SHIFTREG_LEN SHIFTREG_IN_LEN
+#endif
+
+
+
+/** Shadow images, register 0 first. */
+static volatile uint8_t shiftreg_outputs[SHIFTREG_OUT_LEN],
+    shiftreg_inputs[SHIFTREG_IN_LEN];
+/** Transaction buffers, in shifting order. */
+static uint8_t shiftreg_outBuf[SHIFTREG_LEN], shiftreg_inBuf[SHIFTREG_LEN];
+/** Refresh transaction. */
+static Spiint_t shiftreg_transaction = {.done = true};
+/** If outputs changed since the last refresh was started. */
+static volatile bool shiftreg_dirty = false;
+#if SHIFTREG_INTERVAL
+/** Ticks until the next periodic refresh. */
+static uint16_t shiftreg_countdown = 0;
+#endif
+
+
+
+/**
+ * Takes over the shifted in bytes, called when a refresh completed.
+ * 
+ * @param transaction the refresh transaction
+ */
+static void shiftreg_done(Spiint_t *transaction)
+{
+    uint8_t i;
+    
+    (void)transaction;  //suppress unused warning
+    //the 74HC165 next to the microcontroller is shifted in first
+    for(i=0; i<SHIFTREG_IN_LEN; i++)
+        shiftreg_inputs[i] = shiftreg_inBuf[i];
+}
+
+void shiftreg_init(const Spi_config_t *config)
+{
+    SHIFTREG_LATCH_PORT |= (1 << SHIFTREG_LATCH_PIN);
+    SHIFTREG_LATCH_DDR |= (1 << SHIFTREG_LATCH_PIN);
+    SHIFTREG_LOAD_PORT |= (1 << SHIFTREG_LOAD_PIN);
+    SHIFTREG_LOAD_DDR |= (1 << SHIFTREG_LOAD_PIN);
+    
+    shiftreg_transaction = spiint_initTransaction(shiftreg_outBuf,
+        shiftreg_inBuf, SHIFTREG_LEN, &SHIFTREG_LATCH_PORT,
+        SHIFTREG_LATCH_PIN);
+    shiftreg_transaction.config = config;
+    spiint_setCallback(&shiftreg_transaction, shiftreg_done, false);
+    
+    //shift out the initial (low) outputs
+    shiftreg_dirty = true;
+}
+
+
+
+void shiftreg_tick(void)
+{
+    uint8_t i;
+    
+    
+    #if SHIFTREG_INTERVAL
+        if(shiftreg_countdown)
+            shiftreg_countdown--;
+        if(!shiftreg_dirty && shiftreg_countdown)
+            return;
+    #else
+        if(!shiftreg_dirty)
+            return;
+    #endif
+    
+    //combine further changes until the running refresh completed
+    if(!shiftreg_transaction.done)
+        return;
+    
+    //snapshot the outputs, the 74HC595 furthest away is shifted out first
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for(i=0; i<SHIFTREG_OUT_LEN; i++)
+            shiftreg_outBuf[SHIFTREG_LEN-1-i] = shiftreg_outputs[i];
+        shiftreg_dirty = false;
+    }
+    #if SHIFTREG_INTERVAL
+        shiftreg_countdown = SHIFTREG_INTERVAL;
+    #endif
+    
+    //latch the inputs
+    SHIFTREG_LOAD_PORT &= ~(1 << SHIFTREG_LOAD_PIN);
+    SHIFTREG_LOAD_PORT |= (1 << SHIFTREG_LOAD_PIN);
+    
+    //the rising SS (latch) updates the outputs when completed
+    spiint_submit(&shiftreg_transaction);
+}
+
+bool shiftreg_isBusy(void)
+{
+    return shiftreg_dirty || !shiftreg_transaction.done;
+}
+
+
+
+void shiftreg_set(uint16_t bit, bool value)
+{
+    shiftreg_write(bit/8, (value) ? 0xFF : 0x00, 1 << (bit%8));
+}
+
+void shiftreg_toggle(uint16_t bit)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        shiftreg_outputs[bit/8] ^= (1 << (bit%8));
+        shiftreg_dirty = true;
+    }
+}
+
+void shiftreg_write(uint8_t reg, uint8_t value, uint8_t mask)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        shiftreg_outputs[reg] = (shiftreg_outputs[reg] & ~mask)
+            | (value & mask);
+        shiftreg_dirty = true;
+    }
+}
+
+bool shiftreg_getOutput(uint16_t bit)
+{
+    return shiftreg_outputs[bit/8] & (1 << (bit%8));
+}
+
+
+
+bool shiftreg_get(uint16_t bit)
+{
+    return shiftreg_inputs[bit/8] & (1 << (bit%8));
+}
+
+uint8_t shiftreg_read(uint8_t reg)
+{
+    return shiftreg_inputs[reg];
+}
@@ -127,6 +127,61 @@ void spi_init(void)
 
 
 
+Spi_config_t spi_initConfig(uint32_t frequency, uint8_t mode, uint8_t dord)
+{
+    uint32_t f = F_CPU/2;
+    uint8_t i;
+    
+    
+    //i: prescaler 2^(i+1), 0 for 2 up to 6 for 128
+    for(i=0; i<6 && f>frequency; i++)
+        f /= 2;
+    
+    //datasheet table 19-5
+    //odd exponents use SPI2X, except 128 (SPR 11, SPI2X 1 would be 64)
+    return (Spi_config_t){
+        .spcr = (1 << SPE) | ((dord & 1) << DORD) | (1 << MSTR)
+            | (((mode >> 1) & 1) << CPOL) | ((mode & 1) << CPHA)
+            | (((i/2 >> 1) & 1) << SPR1) | ((i/2 & 1) << SPR0),
+        .spsr = (i<6 && !(i & 1)) << SPI2X
+    };
+}
+
+Spi_device_t spi_initDevice(uint32_t frequency, uint8_t mode, uint8_t dord,
+    volatile uint8_t *port, uint8_t pin)
+{
+    return (Spi_device_t){.config = spi_initConfig(frequency, mode, dord),
+        .port = port, .pin = pin};
+}
+
+void spi_setConfig(Spi_config_t config)
+{
+    SPCR = config.spcr | (SPCR & (1 << SPIE));
+    SPSR = config.spsr;
+}
+
+Spi_config_t spi_getConfig(void)
+{
+    return (Spi_config_t){.spcr = SPCR & ~(1 << SPIE),
+        .spsr = SPSR & (1 << SPI2X)};
+}
+
+void spi_select(const Spi_device_t *device)
+{
+    spi_setConfig(device->config);
+    
+    if(device->port)
+        *device->port &= ~(1 << device->pin);
+}
+
+void spi_deselect(const Spi_device_t *device)
+{
+    if(device->port)
+        *device->port |= (1 << device->pin);
+}
+
+
+
 uint8_t spi_writeRead(uint8_t data)
 {
     SPDR = data;
@@ -138,18 +193,69 @@ uint8_t spi_writeRead(uint8_t data)
 
 void spi_writeBurst(uint8_t *out, size_t len)
 {
-    while(len--)
-        spi_writeRead(*out++);
+    uint8_t next;
+    
+    
+    if(!len)
+        return;
+    
+    //MISO is discarded, SPIF gets cleared by the next SPDR write
+    SPDR = *out++;
+    while(--len)
+    {
+        //fetch the next byte while the current one is shifting
+        next = *out++;
+        while(~SPSR & (1 << SPIF))
+            ;
+        SPDR = next;
+    }
+    while(~SPSR & (1 << SPIF))
+        ;
 }
 
 void spi_readBurst(uint8_t *in, size_t len)
 {
-    while(len--)
-        *in++ = spi_writeRead(0x00);
+    spi_readBurstFill(in, len, 0x00);
+}
+
+void spi_readBurstFill(uint8_t *in, size_t len, uint8_t fill)
+{
+    if(!len)
+        return;
+    
+    SPDR = fill;
+    while(--len)
+    {
+        while(~SPSR & (1 << SPIF))
+            ;
+        //start the next byte first, the receive direction is
+        //double buffered so the last byte can be read afterwards
+        SPDR = fill;
+        *in++ = SPDR;
+    }
+    while(~SPSR & (1 << SPIF))
+        ;
+    *in = SPDR;
 }
 
 void spi_writeReadBurst(uint8_t *out, uint8_t *in, size_t len)
 {
-    while(len--)
-        *in++ = spi_writeRead(*out++);
+    uint8_t next;
+    
+    
+    if(!len)
+        return;
+    
+    SPDR = *out++;
+    while(--len)
+    {
+        next = *out++;
+        while(~SPSR & (1 << SPIF))
+            ;
+        SPDR = next;
+        *in++ = SPDR;
+    }
+    while(~SPSR & (1 << SPIF))
+        ;
+    *in = SPDR;
 }
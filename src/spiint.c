@@ -34,6 +34,9 @@
 
 #include <avr/io.h>         //hardware registers
 #include <avr/interrupt.h>  //interrupt vectors
+#include <util/atomic.h>    //atomic blocks
+#include "bus.h"            //bus manager
+#include "defer.h"          //deferred callbacks
 #include "spiint.h"
 
 
@@ -118,16 +121,56 @@ static volatile uint8_t *spiint_out;
 static volatile uint8_t *spiint_in;
 /** Number of bytes left to shift out/in. */
 static volatile size_t spiint_len;
-/** Address of the PORT the SS is connected to, or NULL. */
-static volatile uint8_t *spiint_port;
-/** Number of the corresponding bit (0-7) in the PORT register
- * the SS i connected to. */
-static volatile uint8_t spiint_pin;
+/** Byte to shift out if there is no out location. */
+static volatile uint8_t spiint_fill;
+#ifndef SPIINT_NO_CRC
+/** CRC flags of the running transaction. */
+static volatile uint8_t spiint_crcFlags;
+/** CRCs of the running transaction. */
+static volatile Crc_t spiint_crcOut, spiint_crcIn;
+#endif
+
+/** Queued transactions, the head is the one currently running. */
+static Spiint_t *volatile spiint_head = NULL, *volatile spiint_tail = NULL;
+/** If a transaction is currently shifting. */
+static volatile bool spiint_running = false;
+/** If the queue is held (spiint_lock). */
+static volatile bool spiint_locked = false;
+/** Transaction used by spiint_transmitBurst. */
+static Spiint_t spiint_burst = {.done = true};
+
+/** If the stream is running (it keeps the queue waiting). */
+static volatile bool spiint_streaming = false;
+/** If the stream should stop at the end of the current half. */
+static volatile bool spiint_streamStopping;
+/** Stream buffer (two halves) and length of one half. */
+static uint8_t *spiint_streamBuf;
+static size_t spiint_streamLen;
+/** SS of the stream. */
+static volatile uint8_t *spiint_streamPort;
+static uint8_t spiint_streamPin;
+/** Which halves are filled and ready to be shifted out. */
+static volatile bool spiint_streamReady[2];
+/** Index of the half currently shifting (or waited for). */
+static volatile uint8_t spiint_streamHalf;
+/** If fill bytes are shifted out because the next half isn't ready. */
+static volatile bool spiint_streamUnderrun;
+/** Number of underruns. */
+static volatile uint16_t spiint_streamUnderrunCount;
+/** Called with every shifted out half or NULL. */
+static void (*spiint_streamCallback)(uint8_t *half);
+/** If the half done callback is deferred. */
+static bool spiint_streamDeferred;
+/** Interrupt engine for the bus manager. */
+static const Bus_engine_t spiint_busEngine = {.lock = spiint_lock,
+    .unlock = spiint_unlock, .isRunning = spiint_isRunning};
 
 
 
 void spiint_init(void)
 {
+    bus_setEngine(BUS_SPI, &spiint_busEngine);
+    
     //SS, MOSI, SCK
     DDRB |= (1 << DDB2) | (1 << DDB3) | (1 << DDB5);
     //MISO
@@ -140,55 +183,424 @@ void spiint_init(void)
         | (SPR1_VALUE << SPR1) | (SPR0_VALUE << SPR0);
 }
 
+Spiint_t spiint_initTransaction(uint8_t *out, uint8_t *in, size_t len,
+    volatile uint8_t *port, uint8_t pin)
+{
+    return SPIINT_INIT(out, in, len, port, pin);
+}
+
+Spiint_t spiint_initDeviceTransaction(const Spi_device_t *device,
+    uint8_t *out, uint8_t *in, size_t len)
+{
+    Spiint_t t = SPIINT_INIT(out, in, len, device->port, device->pin);
+    
+    t.config = &device->config;
+    return t;
+}
+
 
 
 bool spiint_isBusy(void)
 {
-    return spiint_len;
+    return spiint_head;
 }
 
 void spiint_flush(void)
 {
-    while(spiint_len)
+    while(spiint_head)
         ;
 }
 
+bool spiint_isRunning(void)
+{
+    return spiint_running;
+}
 
 
-void spiint_transmitBurst(uint8_t *out, uint8_t *in, size_t len,
-    uint8_t *port, uint8_t pin)
+
+/** Calls the callback of a transaction, deferred version. */
+static void spiint_dispatch(void *transaction)
 {
-    //block if a transmission is still going
-    spiint_flush();
+    ((Spiint_t*)transaction)->callback(transaction);
+}
+
+/**
+ * Calls the callback of a completed transaction, if any,
+ * directly or deferred.
+ */
+static void spiint_notify(Spiint_t *t)
+{
+    if(t->callback)
+    {
+        if(t->deferred)
+            defer_post(spiint_dispatch, t);
+        else
+            t->callback(t);
+    }
+}
+
+/**
+ * Starts the transaction at the head of the queue, if any.
+ * Has to be called with interrupts disabled.
+ */
+static void spiint_start(void)
+{
+    Spiint_t *t = spiint_head;
+    uint8_t data;
+    
+    if(!t)
+        spiint_tail = NULL;
+    
+    //hold the queue, the hardware belongs to someone else
+    if(spiint_locked)
+    {
+        SPCR &= ~(1 << SPIE);
+        return;
+    }
+    
+    //nothing to do or the stream keeps the queue waiting
+    if(!t || spiint_streaming)
+        return;
     
-    //save locations
-    spiint_out = out;
-    spiint_in = in;
-    spiint_len = len;
-    spiint_port = port;
-    spiint_pin = pin;
+    spiint_running = true;
+    spiint_out = t->out;
+    spiint_in = t->in;
+    spiint_len = t->len;
+    spiint_fill = t->fill;
+    #ifndef SPIINT_NO_CRC
+        spiint_crcFlags = t->crcFlags;
+        spiint_crcOut = t->crcOut;
+        spiint_crcIn = t->crcIn;
+    #endif
     
+    //switch mode, bit order and clock while SS is still high
+    if(t->config)
+    {
+        SPCR = t->config->spcr | (1 << SPIE);
+        SPSR = t->config->spsr;
+    }
     
     //pull SS low only if provided
-    if(spiint_port)
-        *spiint_port &= ~(1 << spiint_pin);
+    if(t->port)
+        *t->port &= ~(1 << t->pin);
     
     //start transmission
-    SPDR = *spiint_out++;
+    if(spiint_out)
+        data = *spiint_out++;
+    else
+        data = spiint_fill;
+    SPDR = data;
+    
+    #ifndef SPIINT_NO_CRC
+        if(spiint_crcFlags & SPIINT_CRC_OUT)
+            spiint_crcOut = CRC_UPDATE(spiint_crcOut, data);
+    #endif
 }
 
+void spiint_submit(Spiint_t *transaction)
+{
+    transaction->done = false;
+    transaction->next = NULL;
+    
+    //nothing to shift, complete right away
+    if(!transaction->len)
+    {
+        transaction->done = true;
+        spiint_notify(transaction);
+        return;
+    }
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(spiint_head)
+        {
+            spiint_tail->next = transaction;
+            spiint_tail = transaction;
+        }
+        else
+        {
+            spiint_head = spiint_tail = transaction;
+            spiint_start();
+        }
+    }
+}
 
+void spiint_lock(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        spiint_locked = true;
+        //a running transaction disables the interrupt when completed
+        if(!spiint_running)
+            SPCR &= ~(1 << SPIE);
+    }
+}
 
-ISR(SPI_STC_vect)
+void spiint_unlock(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        spiint_locked = false;
+        
+        if(!spiint_running)
+        {
+            //clear a SPIF left over by blocking transfers
+            //(reading SPSR and then SPDR) before enabling the interrupt
+            (void)SPSR;
+            (void)SPDR;
+            SPCR |= (1 << SPIE);
+            
+            if(spiint_head)
+                spiint_start();
+        }
+    }
+}
+
+void spiint_setFill(Spiint_t *transaction, uint8_t fill)
+{
+    transaction->fill = fill;
+}
+
+#ifndef SPIINT_NO_CRC
+void spiint_setCrc(Spiint_t *transaction, uint8_t flags)
 {
-    //save shifted in byte
-    *spiint_in++ = SPDR;
+    transaction->crcFlags = flags;
+    transaction->crcOut = transaction->crcIn = CRC_INIT;
+}
+#endif
+
+void spiint_setCallback(Spiint_t *transaction,
+    void (*callback)(Spiint_t *transaction), bool deferred)
+{
+    transaction->callback = callback;
+    transaction->deferred = deferred;
+}
+
+void spiint_transmitBurst(uint8_t *out, uint8_t *in, size_t len,
+    uint8_t *port, uint8_t pin)
+{
+    //block if the last burst is still going
+    while(!spiint_burst.done)
+        ;
     
-    //continue if not done
-    if(--spiint_len)
+    spiint_burst = spiint_initTransaction(out, in, len, port, pin);
+    spiint_submit(&spiint_burst);
+}
+
+
+
+/** Calls the half done callback, deferred version. */
+static void spiint_streamDispatch(void *half)
+{
+    //the stream might have been restarted without a callback
+    if(spiint_streamCallback)
+        spiint_streamCallback(half);
+}
+
+/**
+ * Continues the stream with the next half or fill bytes at the end
+ * of a half, or stops it.
+ * Called by the interrupt routine.
+ */
+static void spiint_streamNext(void)
+{
+    uint8_t *done = NULL;
+    
+    
+    //a lock stops the stream as well, the hardware is needed elsewhere
+    if(spiint_streamStopping || spiint_locked)
+    {
+        if(spiint_streamPort)
+            *spiint_streamPort |= (1 << spiint_streamPin);
+        spiint_streaming = spiint_streamStopping = false;
+        spiint_running = false;
+        
+        //continue with the waiting queue
+        spiint_start();
+        return;
+    }
+    
+    //a completely shifted out half is handed back to the application
+    if(!spiint_streamUnderrun)
+    {
+        spiint_streamReady[spiint_streamHalf] = false;
+        done = spiint_streamBuf + spiint_streamHalf*spiint_streamLen;
+        spiint_streamHalf ^= 1;
+    }
+    
+    if(spiint_streamReady[spiint_streamHalf])
+    {
+        spiint_streamUnderrun = false;
+        spiint_out = spiint_streamBuf + spiint_streamHalf*spiint_streamLen;
+        spiint_len = spiint_streamLen;
         SPDR = *spiint_out++;
+    }
     else
-        //stop if done
-        if(spiint_port)
-            *spiint_port |= (1 << spiint_pin);
+    {
+        //keep the clock going with fill bytes until the half is ready
+        if(!spiint_streamUnderrun)
+            spiint_streamUnderrunCount++;
+        spiint_streamUnderrun = true;
+        spiint_out = NULL;
+        spiint_len = 1;
+        SPDR = spiint_fill;
+    }
+    
+    if(done && spiint_streamCallback)
+    {
+        if(spiint_streamDeferred)
+            defer_post(spiint_streamDispatch, done);
+        else
+            spiint_streamCallback(done);
+    }
+}
+
+bool spiint_streamStart(uint8_t *buf, size_t len,
+    volatile uint8_t *port, uint8_t pin,
+    void (*callback)(uint8_t *half), bool deferred)
+{
+    bool ret = 1;
+    
+    
+    if(!len)
+        return 1;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(!spiint_running && !spiint_locked && !spiint_head)
+        {
+            spiint_streamBuf = buf;
+            spiint_streamLen = len;
+            spiint_streamPort = port;
+            spiint_streamPin = pin;
+            spiint_streamCallback = callback;
+            spiint_streamDeferred = deferred;
+            spiint_streamReady[0] = spiint_streamReady[1] = true;
+            spiint_streamHalf = 0;
+            spiint_streamUnderrun = spiint_streamStopping = false;
+            spiint_streamUnderrunCount = 0;
+            spiint_streaming = spiint_running = true;
+            
+            spiint_out = buf;
+            spiint_in = NULL;
+            spiint_len = len;
+            spiint_fill = 0x00;
+            #ifndef SPIINT_NO_CRC
+                spiint_crcFlags = 0;
+            #endif
+            
+            if(port)
+                *port &= ~(1 << pin);
+            SPDR = *spiint_out++;
+            ret = 0;
+        }
+    }
+    
+    return ret;
+}
+
+void spiint_streamStop(void)
+{
+    if(spiint_streaming)
+        spiint_streamStopping = true;
+}
+
+uint8_t *spiint_streamFree(void)
+{
+    uint8_t *ret = NULL;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        //the half waited for first during an underrun
+        if(spiint_streaming && !spiint_streamReady[spiint_streamHalf])
+            ret = spiint_streamBuf + spiint_streamHalf*spiint_streamLen;
+        else if(spiint_streaming && !spiint_streamReady[spiint_streamHalf^1])
+            ret = spiint_streamBuf + (spiint_streamHalf^1)*spiint_streamLen;
+    }
+    
+    return ret;
+}
+
+void spiint_streamCommit(uint8_t *half)
+{
+    spiint_streamReady[half != spiint_streamBuf] = true;
+}
+
+uint16_t spiint_streamUnderruns(void)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = spiint_streamUnderrunCount;
+    }
+    
+    return ret;
+}
+
+
+
+ISR(SPI_STC_vect)
+{
+    Spiint_t *t;
+    uint8_t data, out;
+    
+    
+    //continue if not done,
+    //shift out first as the receive direction is double buffered
+    if(--spiint_len)
+    {
+        if(spiint_out)
+            out = *spiint_out++;
+        else
+            out = spiint_fill;
+        SPDR = out;
+        //read immediately, at fosc/2 the next byte completes in 16 cycles
+        data = SPDR;
+        if(spiint_in)
+            *spiint_in++ = data;
+        
+        #ifndef SPIINT_NO_CRC
+            //the CRCs are calculated while the byte is shifting
+            if(spiint_crcFlags & SPIINT_CRC_OUT)
+                spiint_crcOut = CRC_UPDATE(spiint_crcOut, out);
+            if(spiint_crcFlags & SPIINT_CRC_IN)
+                spiint_crcIn = CRC_UPDATE(spiint_crcIn, data);
+        #endif
+        return;
+    }
+    
+    //save last shifted in byte
+    data = SPDR;
+    if(spiint_in)
+        *spiint_in = data;
+    
+    //switch halves if streaming
+    if(spiint_streaming)
+    {
+        spiint_streamNext();
+        return;
+    }
+    
+    //stop if done
+    t = spiint_head;
+    if(t->port && !t->hold)
+        *t->port |= (1 << t->pin);
+    
+    #ifndef SPIINT_NO_CRC
+        if(spiint_crcFlags & SPIINT_CRC_IN)
+            spiint_crcIn = CRC_UPDATE(spiint_crcIn, data);
+        t->crcOut = spiint_crcOut;
+        t->crcIn = spiint_crcIn;
+    #endif
+    
+    t->done = true;
+    spiint_running = false;
+    
+    //chain the next transaction
+    spiint_head = t->next;
+    spiint_start();
+    
+    //notify after the bus is busy again
+    spiint_notify(t);
 }
@@ -0,0 +1,339 @@
+/*
+ * spislave.c
+ * 
+ * Buffered, interrupt based SPI slave driver with SS framing.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/io.h>
+#include <avr/interrupt.h>  //interrupt vectors
+#include <util/atomic.h>    //atomic blocks
+#include "ring.h"
+#include "spislave.h"
+
+
+
+#if SPISLAVE_MODE == 0
+    #define CPOL_VALUE 0
+    #define CPHA_VALUE 0
+#elif SPISLAVE_MODE == 1
+    #define CPOL_VALUE 0
+    #define CPHA_VALUE 1
+#elif SPISLAVE_MODE == 2
+    #define CPOL_VALUE 1
+    #define CPHA_VALUE 0
+#elif SPISLAVE_MODE == 3
+    #define CPOL_VALUE 1
+    #define CPHA_VALUE 1
+#else
+    #error "No valid SPISLAVE_MODE defined!"
+#endif
+
+#if SPISLAVE_DORD == 0
+    #define DORD_VALUE 0
+#elif SPISLAVE_DORD == 1
+    #define DORD_VALUE 1
+#else
+    #error "No valid SPISLAVE_DORD defined!"
+#endif
+
+
+
+/** Transmit and receive fifos and the lengths of the received frames
+ * (two bytes each, little endian). */
+static volatile Ring_t spislave_transmitBuf, spislave_receiveBuf,
+    spislave_frameBuf;
+/** Data locations used by the fifos. */
+static volatile uint8_t spislave_transmitArray[SPISLAVE_BUF_LEN],
+    spislave_receiveArray[SPISLAVE_BUF_LEN],
+    spislave_frameArray[2*SPISLAVE_FRAMES + 1];
+
+/** Byte to load into the data register after the current one. */
+static volatile uint8_t spislave_next;
+/** If spislave_next is a fill byte. */
+static volatile bool spislave_nextFill;
+/** If the byte in the data register is a fill byte. */
+static volatile bool spislave_loadedFill;
+/** If fill bytes are shifted out because the transmit fifo ran empty. */
+static volatile bool spislave_underrun;
+
+/** Number of bytes received in the current frame. */
+static volatile uint16_t spislave_frameLen;
+/** If the current frame is dropped (receive fifo or frame queue full). */
+static volatile bool spislave_frameDrop;
+/** Write location of the receive fifo at the start of the current frame. */
+static uint8_t *volatile spislave_frameStart;
+
+/** Error counters. */
+static volatile uint16_t spislave_underrunCount, spislave_overflowCount;
+
+
+
+/**
+ * Pops the next byte to shift out into spislave_next
+ * or uses SPISLAVE_FILL if there is none.
+ * Has to be called with interrupts disabled.
+ */
+static void spislave_prefetch(void)
+{
+    spislave_nextFill = ring_pop((Ring_t*)&spislave_transmitBuf,
+        (uint8_t*)&spislave_next);
+    if(spislave_nextFill)
+        spislave_next = SPISLAVE_FILL;
+}
+
+/**
+ * Replaces a loaded fill byte with queued data.
+ * Has to be called with interrupts disabled and only while SS is high,
+ * as the data register must not be written during a transfer.
+ */
+static void spislave_refill(void)
+{
+    if(spislave_nextFill)
+        spislave_prefetch();
+    
+    if(spislave_loadedFill && !spislave_nextFill)
+    {
+        SPDR = spislave_next;
+        spislave_loadedFill = false;
+        spislave_prefetch();
+    }
+}
+
+
+
+void spislave_init(void)
+{
+    //init fifos
+    spislave_transmitBuf =
+        ring_init((uint8_t*)spislave_transmitArray, SPISLAVE_BUF_LEN);
+    spislave_receiveBuf =
+        ring_init((uint8_t*)spislave_receiveArray, SPISLAVE_BUF_LEN);
+    spislave_frameBuf =
+        ring_init((uint8_t*)spislave_frameArray, 2*SPISLAVE_FRAMES + 1);
+    
+    
+    //MISO
+    DDRB |= (1 << DDB4);
+    //SS, MOSI, SCK
+    //DDRB &= ~((1 << DDB2) | (1 << DDB3) | (1 << DDB5));
+    
+    SPCR = (1 << SPIE) | (1 << SPE) | (DORD_VALUE << DORD)
+        | (CPOL_VALUE << CPOL) | (CPHA_VALUE << CPHA);
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        SPDR = SPISLAVE_FILL;
+        spislave_loadedFill = true;
+        spislave_prefetch();
+    }
+    
+    //SS edges
+    PCMSK0 |= (1 << PCINT2);
+    PCICR |= (1 << PCIE0);
+}
+
+
+
+//the functions could be exited from within the atomic blocks,
+//but the compiler doesn't know that and will throw a warning if done
+size_t spislave_transmitAvailable(void)
+{
+    size_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_pushAvailable(spislave_transmitBuf);
+    }
+    
+    return ret;
+}
+
+bool spislave_transmitTry(uint8_t *data, size_t len)
+{
+    bool ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_pushBurst((Ring_t*)&spislave_transmitBuf, data, len);
+        
+        //load the new data right away if the bus is idle
+        if(!ret && (PINB & (1 << PINB2)))
+            spislave_refill();
+    }
+    
+    return ret;
+}
+
+
+
+size_t spislave_frameAvailable(void)
+{
+    size_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_popAvailable(spislave_frameBuf) / 2;
+    }
+    
+    return ret;
+}
+
+size_t spislave_receiveFrame(uint8_t *data, size_t len)
+{
+    uint8_t lo = 0, hi = 0, c = 0;
+    size_t frameLen, i;
+    
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(ring_popAvailable(spislave_frameBuf) >= 2)
+        {
+            ring_pop((Ring_t*)&spislave_frameBuf, &lo);
+            ring_pop((Ring_t*)&spislave_frameBuf, &hi);
+        }
+    }
+    frameLen = ((uint16_t)hi << 8) | lo;
+    
+    //the bytes of a frame are in the fifo before its length is queued
+    for(i=0; i<frameLen; i++)
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            ring_pop((Ring_t*)&spislave_receiveBuf, &c);
+        }
+        
+        if(i < len)
+            data[i] = c;
+    }
+    
+    return frameLen;
+}
+
+
+
+uint16_t spislave_underruns(void)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = spislave_underrunCount;
+    }
+    
+    return ret;
+}
+
+uint16_t spislave_overflows(void)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = spislave_overflowCount;
+    }
+    
+    return ret;
+}
+
+
+
+/**
+ * Reloads the data register and takes the received byte,
+ * the receive path of the SPI interrupt.
+ * Has to be called with interrupts disabled and SPIF set.
+ */
+static void spislave_transfer(void)
+{
+    uint8_t data;
+    
+    
+    //reload first, the host may clock the next byte right away,
+    //the receive direction is double buffered
+    SPDR = spislave_next;
+    data = SPDR;
+    
+    //count the underruns, not every fill byte
+    if(spislave_loadedFill && !spislave_underrun)
+        spislave_underrunCount++;
+    spislave_underrun = spislave_loadedFill;
+    spislave_loadedFill = spislave_nextFill;
+    spislave_prefetch();
+    
+    //count the bytes of dropped frames as well to tell them from empty ones
+    spislave_frameLen++;
+    if(!spislave_frameDrop
+            && ring_push((Ring_t*)&spislave_receiveBuf, data))
+    {
+        //no truncated frames, take back the bytes received so far
+        spislave_receiveBuf.write = spislave_frameStart;
+        spislave_frameDrop = true;
+    }
+}
+
+
+
+ISR(SPI_STC_vect)
+{
+    spislave_transfer();
+}
+
+ISR(PCINT0_vect)
+{
+    if(~PINB & (1 << PINB2))
+    {
+        //frame start, drop it if its length can't be queued
+        spislave_frameLen = 0;
+        spislave_underrun = false;
+        spislave_frameStart = spislave_receiveBuf.write;
+        spislave_frameDrop = ring_pushAvailable(spislave_frameBuf) < 2;
+    }
+    else
+    {
+        //frame end, the pin change interrupt has the higher priority,
+        //so take the last byte first if its interrupt is still pending
+        //(reading SPSR and then SPDR clears SPIF)
+        if(SPSR & (1 << SPIF))
+            spislave_transfer();
+        
+        if(spislave_frameLen && spislave_frameDrop)
+        {
+            spislave_overflowCount++;
+        }
+        else if(spislave_frameLen)
+        {
+            ring_push((Ring_t*)&spislave_frameBuf, spislave_frameLen);
+            ring_push((Ring_t*)&spislave_frameBuf, spislave_frameLen >> 8);
+        }
+        
+        spislave_refill();
+    }
+}
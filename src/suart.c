@@ -0,0 +1,571 @@
+/*
+ * suart.c
+ * 
+ * Buffered, timer and interrupt based software UART driver.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/io.h>         //hardware registers
+#include <avr/interrupt.h>  //interrupt vectors
+#include <util/atomic.h>    //atomic blocks
+#include "ring.h"           //buffers
+#include "suart.h"
+
+
+
+//default to Arduino oscillator
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+    #warning "F_CPU not defined! Assuming 16MHz."
+#endif
+
+
+//define timer parameters
+//set prescaler to the lowest value possible
+//so that a bit period fits into the 8 bit timer
+#define SUART_TICKS_MAX 0xFF
+
+#if SUART_TIMER == 0
+    #define SUART_TCNT TCNT0
+    #define SUART_OCRA OCR0A
+    #define SUART_OCRB OCR0B
+    #define SUART_TCCRA TCCR0A
+    #define SUART_TCCRB TCCR0B
+    #define SUART_TIMSK TIMSK0
+    #define SUART_TIFR TIFR0
+    #define SUART_COMB0 COM0B0
+    #define SUART_COMB1 COM0B1
+    #define SUART_FOCB FOC0B
+    #define SUART_CS0 CS00
+    #define SUART_CS1 CS01
+    #define SUART_CS2 CS02
+    #define SUART_OCIEA OCIE0A
+    #define SUART_OCIEB OCIE0B
+    #define SUART_OCFA OCF0A
+    #define SUART_OCFB OCF0B
+    #define SUART_RX_vect TIMER0_COMPA_vect
+    #define SUART_TX_vect TIMER0_COMPB_vect
+    #define SUART_TX_DDR DDRD
+    #define SUART_TX_DD DDD5
+    
+    #if F_CPU / 1 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 1
+        #define SUART_CS0_VALUE 1
+        #define SUART_CS1_VALUE 0
+        #define SUART_CS2_VALUE 0
+    #elif F_CPU / 8 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 8
+        #define SUART_CS0_VALUE 0
+        #define SUART_CS1_VALUE 1
+        #define SUART_CS2_VALUE 0
+    #elif F_CPU / 64 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 64
+        #define SUART_CS0_VALUE 1
+        #define SUART_CS1_VALUE 1
+        #define SUART_CS2_VALUE 0
+    #elif F_CPU / 256 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 256
+        #define SUART_CS0_VALUE 0
+        #define SUART_CS1_VALUE 0
+        #define SUART_CS2_VALUE 1
+    #elif F_CPU / 1024 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 1024
+        #define SUART_CS0_VALUE 1
+        #define SUART_CS1_VALUE 0
+        #define SUART_CS2_VALUE 1
+    #else
+        #error "SUART_BAUD too low!"
+    #endif
+    
+#elif SUART_TIMER == 2
+    #define SUART_TCNT TCNT2
+    #define SUART_OCRA OCR2A
+    #define SUART_OCRB OCR2B
+    #define SUART_TCCRA TCCR2A
+    #define SUART_TCCRB TCCR2B
+    #define SUART_TIMSK TIMSK2
+    #define SUART_TIFR TIFR2
+    #define SUART_COMB0 COM2B0
+    #define SUART_COMB1 COM2B1
+    #define SUART_FOCB FOC2B
+    #define SUART_CS0 CS20
+    #define SUART_CS1 CS21
+    #define SUART_CS2 CS22
+    #define SUART_OCIEA OCIE2A
+    #define SUART_OCIEB OCIE2B
+    #define SUART_OCFA OCF2A
+    #define SUART_OCFB OCF2B
+    #define SUART_RX_vect TIMER2_COMPA_vect
+    #define SUART_TX_vect TIMER2_COMPB_vect
+    #define SUART_TX_DDR DDRD
+    #define SUART_TX_DD DDD3
+    
+    #if F_CPU / 1 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 1
+        #define SUART_CS0_VALUE 1
+        #define SUART_CS1_VALUE 0
+        #define SUART_CS2_VALUE 0
+    #elif F_CPU / 8 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 8
+        #define SUART_CS0_VALUE 0
+        #define SUART_CS1_VALUE 1
+        #define SUART_CS2_VALUE 0
+    #elif F_CPU / 32 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 32
+        #define SUART_CS0_VALUE 1
+        #define SUART_CS1_VALUE 1
+        #define SUART_CS2_VALUE 0
+    #elif F_CPU / 64 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 64
+        #define SUART_CS0_VALUE 0
+        #define SUART_CS1_VALUE 0
+        #define SUART_CS2_VALUE 1
+    #elif F_CPU / 128 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 128
+        #define SUART_CS0_VALUE 1
+        #define SUART_CS1_VALUE 0
+        #define SUART_CS2_VALUE 1
+    #elif F_CPU / 256 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 256
+        #define SUART_CS0_VALUE 0
+        #define SUART_CS1_VALUE 1
+        #define SUART_CS2_VALUE 1
+    #elif F_CPU / 1024 / SUART_BAUD <= SUART_TICKS_MAX
+        #define SUART_PRESCALER 1024
+        #define SUART_CS0_VALUE 1
+        #define SUART_CS1_VALUE 1
+        #define SUART_CS2_VALUE 1
+    #else
+        #error "SUART_BAUD too low!"
+    #endif
+    
+#else
+    #error "No valid SUART_TIMER selected!"
+#endif
+
+#if SUART_INT == 0
+    #define SUART_INTx INT0
+    #define SUART_INTFx INTF0
+    #define SUART_ISCx0 ISC00
+    #define SUART_ISCx1 ISC01
+    #define SUART_INT_vect INT0_vect
+    #define SUART_RX_PORT PORTD
+    #define SUART_RX_PIN PIND
+    #define SUART_RX_BIT PIND2
+#elif SUART_INT == 1
+    #if SUART_TIMER == 2
+        #error "SUART_TIMER 2 and SUART_INT 1 share PD3!"
+    #endif
+    #define SUART_INTx INT1
+    #define SUART_INTFx INTF1
+    #define SUART_ISCx0 ISC10
+    #define SUART_ISCx1 ISC11
+    #define SUART_INT_vect INT1_vect
+    #define SUART_RX_PORT PORTD
+    #define SUART_RX_PIN PIND
+    #define SUART_RX_BIT PIND3
+#else
+    #error "No valid SUART_INT selected!"
+#endif
+
+/** Timer ticks per bit, rounded. */
+#define SUART_BIT_TICKS \
+    ((uint8_t)((F_CPU / SUART_PRESCALER + SUART_BAUD / 2) / SUART_BAUD))
+/** Timer ticks from the start bit edge to its middle,
+ * minus the approximate interrupt latency (32 cycles). */
+#define SUART_HALF_TICKS \
+    ((uint8_t)(SUART_BIT_TICKS / 2 - 32 / SUART_PRESCALER))
+
+#if F_CPU / SUART_BAUD < 200
+    #error "SUART_BAUD too high for software bit timing!"
+#endif
+
+
+/** Output compare mode: clear OCxB on match (space, 0). */
+#define SUART_COM_CLEAR (1 << SUART_COMB1)
+/** Output compare mode: set OCxB on match (mark, 1). */
+#define SUART_COM_SET ((1 << SUART_COMB1) | (1 << SUART_COMB0))
+/** Sets the level that OCxB will take at the next compare match. */
+#define SUART_SET_NEXT(com) \
+    (SUART_TCCRA = (SUART_TCCRA \
+        & ~((1 << SUART_COMB1) | (1 << SUART_COMB0))) | (com))
+
+/** Transmitter state: after the stop bit started with an empty buffer. */
+#define SUART_TX_STOPPING 10
+
+
+
+/** Stream function wrapper. */
+static int suart_putc(char c, FILE *stream)
+{
+    (void)stream;   //suppress unused warning
+    if(suart_transmit(c))
+        return _FDEV_EOF;
+    
+    return c;
+}
+/** Stream function wrapper. */
+static int suart_getc(FILE *stream)
+{
+    uint8_t c;
+    
+    (void)stream;   //suppress unused warning
+    if(suart_receive(&c))
+        return _FDEV_EOF;
+    
+    return c;
+}
+
+//stream setups
+//https://www.nongnu.org/avr-libc/user-manual/group__avr__stdio.html
+FILE suart_out = FDEV_SETUP_STREAM(suart_putc, NULL, _FDEV_SETUP_WRITE);
+FILE suart_in = FDEV_SETUP_STREAM(NULL, suart_getc, _FDEV_SETUP_READ);
+
+
+
+/** Transmit and receive fifos. */
+static volatile Ring_t suart_transmitBuf, suart_receiveBuf;
+/** Transmit and receive data locations used by the fifos. */
+static volatile uint8_t suart_transmitArray[SUART_BUF_LEN],
+    suart_receiveArray[SUART_BUF_LEN];
+
+/** If the transmitter is running. */
+static volatile bool suart_transmitting = false;
+/** Byte currently shifted out, LSB first. */
+static volatile uint8_t suart_txData;
+/** Next bit to prepare: 0-7 data bits, 8 stop bit,
+ * 9 after the stop bit started, SUART_TX_STOPPING. */
+static volatile uint8_t suart_txBit;
+/** Byte currently shifted in, LSB first. */
+static volatile uint8_t suart_rxData;
+/** Next bit to sample: 0 start bit, 1-8 data bits, 9 stop bit. */
+static volatile uint8_t suart_rxBit;
+/** Number of framing errors. */
+static volatile uint8_t suart_frameErrorCount = 0;
+
+
+
+void suart_init(void)
+{
+    //init fifos
+    suart_transmitBuf =
+        ring_init((uint8_t*)suart_transmitArray, SUART_BUF_LEN);
+    suart_receiveBuf =
+        ring_init((uint8_t*)suart_receiveArray, SUART_BUF_LEN);
+    
+    
+    //TX idles high, force OCxB high before making it an output
+    SUART_SET_NEXT(SUART_COM_SET);
+    SUART_TCCRB |= (1 << SUART_FOCB);
+    SUART_TX_DDR |= (1 << SUART_TX_DD);
+    
+    //RX with pull-up, falling edge of the start bit
+    SUART_RX_PORT |= (1 << SUART_RX_BIT);
+    EICRA = (EICRA & ~(1 << SUART_ISCx0)) | (1 << SUART_ISCx1);
+    EIFR = (1 << SUART_INTFx);
+    EIMSK |= (1 << SUART_INTx);
+    
+    //free running timer in normal mode
+    SUART_TCCRB |= (SUART_CS2_VALUE << SUART_CS2)
+        | (SUART_CS1_VALUE << SUART_CS1) | (SUART_CS0_VALUE << SUART_CS0);
+}
+
+
+
+char *suart_ngets(char *s, size_t n)
+{
+    uint8_t c;
+    //next index to write to
+    static size_t i = 0;
+    
+    
+    while(!suart_receive(&c))
+    {
+        s[i++] = c;
+        
+        if(c == '\n' || i >= n-1)
+        {
+            s[i] = '\0';
+            i = 0;
+            
+            return s;
+        }
+    }
+    
+    return NULL;
+}
+
+
+
+/**
+ * Starts the transmitter if it is idle and there is data to transmit.
+ * Has to be called with interrupts disabled.
+ */
+static void suart_startTransmitter(void)
+{
+    uint8_t c;
+    
+    if(suart_transmitting || ring_pop((Ring_t*)&suart_transmitBuf, &c))
+        return;
+    
+    suart_transmitting = true;
+    suart_txData = c;
+    suart_txBit = 0;
+    
+    //start bit one bit period from now
+    SUART_SET_NEXT(SUART_COM_CLEAR);
+    SUART_OCRB = SUART_TCNT + SUART_BIT_TICKS;
+    SUART_TIFR = (1 << SUART_OCFB);
+    SUART_TIMSK |= (1 << SUART_OCIEB);
+}
+
+
+
+//the functions could be exited from within the atomic blocks,
+//but the compiler doesn't know that and will throw a warning if done
+size_t suart_transmitAvailable(void)
+{
+    size_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_pushAvailable(suart_transmitBuf);
+    }
+    
+    return ret;
+}
+
+void suart_transmitFlush(void)
+{
+    bool busy;
+    
+    do
+    {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            busy = suart_transmitting;
+        }
+    } while(busy);
+}
+
+bool suart_transmit(uint8_t data)
+{
+    bool ret;
+    
+    
+    //wait for available location
+    while(ring_isFull(suart_transmitBuf))
+        ;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_push((Ring_t*)&suart_transmitBuf, data);
+        suart_startTransmitter();
+    }
+    
+    return ret;
+}
+
+size_t suart_transmitBurst(uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    
+    while(i<len && !suart_transmit(*data++))
+        i++;
+    
+    return i;
+}
+
+bool suart_transmitTry(uint8_t *data, size_t len)
+{
+    bool ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_pushBurst((Ring_t*)&suart_transmitBuf, data, len);
+        suart_startTransmitter();
+    }
+    
+    return ret;
+}
+
+
+size_t suart_receiveAvailable(void)
+{
+    size_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_popAvailable(suart_receiveBuf);
+    }
+    
+    return ret;
+}
+
+bool suart_receivePeek(uint8_t *data)
+{
+    bool ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_peek((Ring_t*)&suart_receiveBuf, data);
+    }
+    
+    return ret;
+}
+
+bool suart_receive(uint8_t *data)
+{
+    bool ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_pop((Ring_t*)&suart_receiveBuf, data);
+    }
+    
+    return ret;
+}
+
+size_t suart_receiveBurst(uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    
+    while(i<len && !suart_receive(data++))
+        i++;
+    
+    return i;
+}
+
+uint8_t suart_frameErrors(void)
+{
+    uint8_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = suart_frameErrorCount;
+        suart_frameErrorCount = 0;
+    }
+    
+    return ret;
+}
+
+
+
+//transmitter, the compare match just put the prepared bit on the line,
+//prepare the next one
+ISR(SUART_TX_vect)
+{
+    uint8_t c;
+    
+    
+    SUART_OCRB += SUART_BIT_TICKS;
+    
+    if(suart_txBit < 8)
+    {
+        SUART_SET_NEXT((suart_txData & 0x01)
+            ? SUART_COM_SET : SUART_COM_CLEAR);
+        suart_txData >>= 1;
+        suart_txBit++;
+    }
+    else if(suart_txBit == 8)
+    {
+        SUART_SET_NEXT(SUART_COM_SET);
+        suart_txBit++;
+    }
+    //stop bit started or completed
+    else if(!ring_pop((Ring_t*)&suart_transmitBuf, &c))
+    {
+        SUART_SET_NEXT(SUART_COM_CLEAR);
+        suart_txData = c;
+        suart_txBit = 0;
+    }
+    //wait for the stop bit to complete before going idle
+    else if(suart_txBit != SUART_TX_STOPPING)
+    {
+        suart_txBit = SUART_TX_STOPPING;
+    }
+    else
+    {
+        SUART_TIMSK &= ~(1 << SUART_OCIEB);
+        suart_transmitting = false;
+    }
+}
+
+//start bit edge
+ISR(SUART_INT_vect)
+{
+    //sample in the middle of the start bit
+    SUART_OCRA = SUART_TCNT + SUART_HALF_TICKS;
+    SUART_TIFR = (1 << SUART_OCFA);
+    SUART_TIMSK |= (1 << SUART_OCIEA);
+    
+    //ignore the edges of the data bits
+    EIMSK &= ~(1 << SUART_INTx);
+    suart_rxBit = 0;
+}
+
+//receiver, middle of a bit
+ISR(SUART_RX_vect)
+{
+    bool level = SUART_RX_PIN & (1 << SUART_RX_BIT);
+    
+    
+    SUART_OCRA += SUART_BIT_TICKS;
+    
+    if(suart_rxBit == 0 && level)
+    {
+        //glitch, not a start bit, wait for the next one
+    }
+    else if(suart_rxBit < 9)
+    {
+        if(suart_rxBit)
+            suart_rxData = (suart_rxData >> 1) | (level ? 0x80 : 0x00);
+        suart_rxBit++;
+        return;
+    }
+    else if(level)
+    {
+        #ifdef SUART_OVERWRITE
+            ring_pushOver((Ring_t*)&suart_receiveBuf, suart_rxData);
+        #else
+            ring_push((Ring_t*)&suart_receiveBuf, suart_rxData);
+        #endif
+    }
+    else if(suart_frameErrorCount < UINT8_MAX)
+    {
+        suart_frameErrorCount++;
+    }
+    
+    //wait for the next start bit
+    SUART_TIMSK &= ~(1 << SUART_OCIEA);
+    EIFR = (1 << SUART_INTFx);
+    EIMSK |= (1 << SUART_INTx);
+}
@@ -0,0 +1,163 @@
+/*
+ * telemetry.c
+ * 
+ * Delta and varint compressed telemetry stream over the buffered UART.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <stddef.h>     //size_t type
+#include "uartint.h"    //transmit buffer
+#include "telemetry.h"
+
+
+
+Telemetry_t telemetry_init(int16_t *last, uint8_t n, uint8_t interval)
+{
+    //clamped by the macro
+    return TELEMETRY_INIT(last, n, interval);
+}
+
+
+
+/**
+ * Appends a 16 bit value as zigzag varint (1 to 3 bytes).
+ * Small positive and negative values both end up with few bytes.
+ * 
+ * @param p location to write to
+ * @param value signed value to encode
+ * @return location after the written bytes
+ */
+static uint8_t *telemetry_varint(uint8_t *p, int16_t value)
+{
+    //zigzag: 0, -1, 1, -2, ... -> 0, 1, 2, 3, ...
+    uint16_t z = ((uint16_t)value << 1) ^ (uint16_t)(value >> 15);
+    
+    while(z >= 0x80)
+    {
+        *p++ = (z & 0x7F) | 0x80;
+        z >>= 7;
+    }
+    *p++ = z;
+    
+    return p;
+}
+
+
+
+/**
+ * Computes the CRC-8 check byte of a record, bitwise,
+ * so the stream doesn't depend on the configuration of the crc module.
+ * 
+ * @param p location of the record
+ * @param end location after the record
+ * @return the check byte
+ */
+static uint8_t telemetry_crc(const uint8_t *p, const uint8_t *end)
+{
+    uint8_t crc = 0, i;
+    
+    while(p < end)
+    {
+        crc ^= *p++;
+        for(i=0; i<8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ TELEMETRY_CRC_POLY : crc << 1;
+    }
+    
+    return crc;
+}
+
+/**
+ * COBS encodes a record in place and appends the delimiter.
+ * The record starts at frame[1], frame[0] is the first code byte.
+ * Records are shorter than 254 bytes, so there is only one block.
+ * 
+ * @param frame location of the frame
+ * @param end location after the record
+ * @return location after the delimiter
+ */
+static uint8_t *telemetry_cobs(uint8_t *frame, uint8_t *end)
+{
+    uint8_t *code = frame, *p;
+    
+    //every zero becomes the distance to the next zero (or the end)
+    for(p=frame+1; p<end; p++)
+    {
+        if(*p == TELEMETRY_DELIMITER)
+        {
+            *code = p - code;
+            code = p;
+        }
+    }
+    *code = p - code;
+    *p++ = TELEMETRY_DELIMITER;
+    
+    return p;
+}
+
+
+
+bool telemetry_write(Telemetry_t *stream, int16_t *samples)
+{
+    uint8_t frame[TELEMETRY_FRAME_MAX], *p = frame + 1;
+    bool key = !stream->countdown;
+    uint8_t i;
+    
+    
+    if(stream->n > TELEMETRY_N_MAX)
+        return 1;
+    
+    *p++ = (key ? TELEMETRY_KEY : 0) | (stream->seq & TELEMETRY_SEQ);
+    for(i=0; i<stream->n; i++)
+        p = telemetry_varint(p, key ? samples[i]
+            : (int16_t)((uint16_t)samples[i] - (uint16_t)stream->last[i]));
+    *p = telemetry_crc(frame + 1, p);
+    p = telemetry_cobs(frame, p + 1);
+    
+    //keep the reference values if the host didn't get the record
+    if(uartint_transmitTry(frame, p - frame))
+    {
+        if(stream->dropped < UINT16_MAX)
+            stream->dropped++;
+        return 1;
+    }
+    
+    for(i=0; i<stream->n; i++)
+        stream->last[i] = samples[i];
+    stream->seq++;
+    stream->countdown = (key ? stream->interval : stream->countdown) - 1;
+    
+    return 0;
+}
+
+void telemetry_keyframe(Telemetry_t *stream)
+{
+    stream->countdown = 0;
+}
@@ -33,6 +33,7 @@
 
 
 #include <avr/io.h>     //hardware registers
+#include <util/delay.h> //recovery clock
 #include <util/twi.h>   //TWI status masks
 #include "twi.h"
 
@@ -80,6 +81,17 @@
 /** Mask TWI slave addressing byte  with given id and read intend. */
 #define TWI_ADDRESS_R(id)    (((id) << 1) | 0x01)
 
+/** SCL and SDA pins. */
+#define TWI_SCL PORTC5
+#define TWI_SDA PORTC4
+/** Half period of the recovery clock in microseconds (100kHz). */
+#define TWI_RECOVER_DELAY 5
+
+
+
+/** If a timeout occurred since the last START. */
+static bool twi_timeout = false;
+
 
 
 void twi_init(void)
@@ -92,22 +104,81 @@ void twi_init(void)
 
 
 
+bool twi_recover(void)
+{
+    uint8_t i;
+    
+    
+    //take the pins over, emulate open drain outputs
+    //(low when output, released to the pull-ups when input)
+    TWCR = 0;
+    DDRC &= ~((1 << TWI_SCL) | (1 << TWI_SDA));
+    PORTC &= ~((1 << TWI_SCL) | (1 << TWI_SDA));
+    
+    //clock out the byte the slave is stuck in
+    for(i=0; i<9 && !(PINC & (1 << TWI_SDA)); i++)
+    {
+        DDRC |= (1 << TWI_SCL);
+        _delay_us(TWI_RECOVER_DELAY);
+        DDRC &= ~(1 << TWI_SCL);
+        _delay_us(TWI_RECOVER_DELAY);
+    }
+    
+    //STOP, SDA rising while SCL is high
+    DDRC |= (1 << TWI_SCL);
+    _delay_us(TWI_RECOVER_DELAY);
+    DDRC |= (1 << TWI_SDA);
+    _delay_us(TWI_RECOVER_DELAY);
+    DDRC &= ~(1 << TWI_SCL);
+    _delay_us(TWI_RECOVER_DELAY);
+    DDRC &= ~(1 << TWI_SDA);
+    _delay_us(TWI_RECOVER_DELAY);
+    
+    twi_init();
+    
+    return !(PINC & (1 << TWI_SDA));
+}
+
+bool twi_timedOut(void)
+{
+    return twi_timeout;
+}
+
+
+
 /**
- * Blocks until the current condition is completed.
+ * Blocks until the current condition is completed
+ * or TWI_TIMEOUT passed, recovers the bus in that case.
+ * 
+ * @return 0 on completion, 1 on timeout
  */
-static void twi_waitForComplete(void)
+static bool twi_waitForComplete(void)
 {
-    while(~TWCR & (1 << TWINT))
-        ;
+    //TWI_TIMEOUT may exceed 16 bit
+    uint32_t i;
+    
+    
+    for(i=0; i<TWI_TIMEOUT; i++)
+    {
+        if(TWCR & (1 << TWINT))
+            return 0;
+        _delay_us(1);
+    }
+    
+    twi_timeout = true;
+    twi_recover();
+    return 1;
 }
 
 
 
 bool twi_start(void)
 {
+    twi_timeout = false;
     TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN);
     
-    twi_waitForComplete();
+    if(twi_waitForComplete())
+        return 1;
     
     return TW_STATUS != TW_START;
 }
@@ -116,7 +187,8 @@ bool twi_repStart(void)
 {
     TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN);
     
-    twi_waitForComplete();
+    if(twi_waitForComplete())
+        return 1;
     
     return TW_STATUS != TW_REP_START;
 }
@@ -132,7 +204,8 @@ bool twi_addressWrite(uint8_t address)
     TWDR = TWI_ADDRESS_W(address);
     TWCR = (1 << TWINT) | (1 << TWEN);
     
-    twi_waitForComplete();
+    if(twi_waitForComplete())
+        return 1;
     
     return TW_STATUS != TW_MT_SLA_ACK;
 }
@@ -142,7 +215,8 @@ bool twi_addressRead(uint8_t address)
     TWDR = TWI_ADDRESS_R(address);
     TWCR = (1 << TWINT) | (1 << TWEN);
     
-    twi_waitForComplete();
+    if(twi_waitForComplete())
+        return 1;
     
     return TW_STATUS != TW_MR_SLA_ACK;
 }
@@ -153,7 +227,8 @@ bool twi_write(uint8_t data)
     TWDR = data;
     TWCR = (1 << TWINT) | (1 << TWEN);
     
-    twi_waitForComplete();
+    if(twi_waitForComplete())
+        return 1;
     
     return TW_STATUS != TW_MT_DATA_ACK;
 }
@@ -176,7 +251,8 @@ size_t twi_writeBurst(uint8_t *data, size_t len)
 bool twi_readAck(uint8_t *data)
 {
     TWCR = (1 << TWINT) | (1 << TWEA) | (1 << TWEN);
-    twi_waitForComplete();
+    if(twi_waitForComplete())
+        return 1;
     
     *data = TWDR;
     
@@ -200,7 +276,8 @@ size_t twi_readAckBurst(uint8_t *data, size_t len)
 bool twi_readNoAck(uint8_t *data)
 {
     TWCR = (1 << TWINT) | (1 << TWEN);
-    twi_waitForComplete();
+    if(twi_waitForComplete())
+        return 1;
     
     *data = TWDR;
     
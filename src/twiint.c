@@ -35,6 +35,13 @@
 #include <avr/io.h>         //hardware registers
 #include <avr/interrupt.h>  //interrupt vectors
 #include <util/twi.h>       //TWI status masks
+#include <util/atomic.h>    //atomic blocks
+#include <avr/wdt.h>        //watchdog reset
+#include <util/delay.h>     //flush timeout
+#include <stdint.h>         //uintptr_t type
+#include "bus.h"            //bus manager
+#include "defer.h"          //deferred callbacks
+#include "twi.h"            //bus recovery
 #include "twiint.h"
 
 
@@ -77,84 +84,539 @@
 
 
 
-/** Slave address byte (with read/write bit). */
-static uint8_t twiint_address;
-/** Location where the next byte that has been read will be written to
-or the next byte that should be written will be read from. */
-static uint8_t *twiint_data;
-/** Number of bytes already transmitted. */
+/** Queued transactions, head is the running one. */
+static Twiint_t *volatile twiint_head = NULL, *volatile twiint_tail = NULL;
+/** Number of bytes already transmitted in the current direction. */
 static size_t twiint_index;
-/** Number of bytes that should be transmitted. */
-static size_t twiint_len;
+/** Descriptor of the transmissions started by twiint_start. */
+static Twiint_t twiint_internal = {.status = TWIINT_OK};
+/** Register byte of twiint_startReadRegister. */
+static uint8_t twiint_reg;
+/** Completion callback of twiint_start or NULL. */
+static void (*volatile twiint_callback)(Twiint_status_t status) = NULL;
+/** If the completion callback is deferred. */
+static volatile bool twiint_deferred;
+/** If the queue is held (twiint_lock). */
+static volatile bool twiint_locked = false;
+/** Retries of the running transaction. */
+static uint8_t twiint_nackRetries = 0, twiint_arbRetries = 0;
+/** Number of TWI interrupts (bus progress), wrapping around. */
+static volatile uint8_t twiint_events = 0;
+#if TWIINT_TIMEOUT_MS
+/** Interrupt count at the last tick. */
+static uint8_t twiint_tickEvents;
+/** Number of ticks without progress. */
+static uint16_t twiint_idleTicks;
+#endif
+#if TWIINT_WATCHDOG
+/** Watchdog configuration of the application while supervising. */
+static uint8_t twiint_wdtcsr;
+/** If the watchdog is supervising. */
+static bool twiint_wdtActive = false;
+#endif
+#if TWIINT_STATS
+/** Statistics of the first used addresses. */
+static volatile Twiint_stats_t twiint_statsTable[TWIINT_STATS];
+/** Number of used statistics entries. */
+static volatile uint8_t twiint_statsLen = 0;
+#endif
+/** Interrupt engine for the bus manager. */
+static const Bus_engine_t twiint_busEngine = {.lock = twiint_lock,
+    .unlock = twiint_unlock, .isRunning = twiint_isRunning};
 
 
 
 void twiint_init(void)
 {
+    bus_setEngine(BUS_TWI, &twiint_busEngine);
+    
+    #if TWIINT_STATS
+        twiint_clearStats();
+    #endif
     TWBR = TWBR_VALUE;
     TWSR = (TWPS1_VALUE << TWPS1) | (TWPS0_VALUE << TWPS0);
     
     TWCR = (1 << TWINT) | (1 << TWEN);
 }
 
+Twiint_t twiint_initTransaction(uint8_t address,
+    uint8_t *out, size_t outLen, uint8_t *in, size_t inLen)
+{
+    return TWIINT_INIT(address, out, outLen, in, inLen);
+}
+
 
 
 bool twiint_busy(void)
+{
+    return twiint_head;
+}
+
+bool twiint_isRunning(void)
 {
     return TWCR & (1<<TWIE);
 }
 
-void twiint_flush(void)
+Twiint_status_t twiint_status(void)
 {
-    while(TWCR & (1<<TWIE))
-        ;
+    return twiint_internal.status;
+}
+
+size_t twiint_count(void)
+{
+    size_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = twiint_internal.count;
+    }
+    
+    return ret;
+}
+
+void twiint_setCallback(void (*callback)(Twiint_status_t status),
+    bool deferred)
+{
+    twiint_callback = callback;
+    twiint_deferred = deferred;
+}
+
+
+
+/** Calls the global completion callback, deferred version. */
+static void twiint_dispatchStatus(void *status)
+{
+    //the callback might have been removed in the meantime
+    if(twiint_callback)
+        twiint_callback((Twiint_status_t)(uintptr_t)status);
 }
 
+/**
+ * Reports the status of a transmission started by twiint_start
+ * to the global completion callback.
+ * 
+ * @param transaction the internal descriptor
+ */
+static void twiint_internalDone(Twiint_t *transaction)
+{
+    if(twiint_callback)
+    {
+        if(twiint_deferred)
+            defer_post(twiint_dispatchStatus,
+                (void*)(uintptr_t)transaction->status);
+        else
+            twiint_callback(transaction->status);
+    }
+}
 
+/**
+ * Queues the internal descriptor after the last one completed.
+ * 
+ * @param address address of the slave (7-bit)
+ * @param out location of the bytes to write
+ * @param outLen number of bytes to write
+ * @param in location where the read bytes should be written to
+ * @param inLen number of bytes to read
+ */
+static void twiint_startInternal(uint8_t address,
+    uint8_t *out, size_t outLen, uint8_t *in, size_t inLen)
+{
+    twiint_internal = twiint_initTransaction(address, out, outLen,
+        in, inLen);
+    twiint_setTransactionCallback(&twiint_internal, twiint_internalDone,
+        false);
+    twiint_submit(&twiint_internal);
+}
 
 void twiint_start(uint8_t address, uint8_t *data, size_t len)
 {
-    twiint_flush();
+    while(twiint_internal.status == TWIINT_BUSY)
+        ;
+    
+    if(address & 0x01)
+        twiint_startInternal(address >> 1, NULL, 0, data, len);
+    else
+        twiint_startInternal(address >> 1, data, len, NULL, 0);
+}
+
+void twiint_startWriteRead(uint8_t address, uint8_t *out, size_t outLen,
+    uint8_t *in, size_t inLen)
+{
+    while(twiint_internal.status == TWIINT_BUSY)
+        ;
     
-    twiint_address = address;
-    twiint_data = data;
-    twiint_len = len;
+    twiint_startInternal(address, out, outLen, in, inLen);
+}
+
+void twiint_startReadRegister(uint8_t address, uint8_t reg,
+    uint8_t *data, size_t len)
+{
+    while(twiint_internal.status == TWIINT_BUSY)
+        ;
     
-    TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+    twiint_reg = reg;
+    twiint_startInternal(address, &twiint_reg, 1, data, len);
+}
+
+
+
+/**
+ * Starts or stops the supervision of the running transaction
+ * (timeout ticks and watchdog timer), restarting its period.
+ * The watchdog configuration of the application is restored when stopping.
+ * Has to be called with interrupts disabled.
+ * 
+ * @param enable if the supervision should be enabled
+ */
+static void twiint_watchdog(bool enable)
+{
+    #if TWIINT_TIMEOUT_MS
+        twiint_idleTicks = 0;
+    #endif
+    
+    #if TWIINT_WATCHDOG
+        wdt_reset();
+        if(enable && !twiint_wdtActive)
+        {
+            twiint_wdtcsr = WDTCSR & ~(1 << WDIF);
+            twiint_wdtActive = true;
+        }
+        else if(!enable && twiint_wdtActive)
+        {
+            twiint_wdtActive = false;
+        }
+        else
+        {
+            return;
+        }
+        
+        //16ms (no prescaler), interrupt mode only
+        WDTCSR = (1 << WDCE) | (1 << WDE);
+        WDTCSR = (enable) ? (1 << WDIE) : twiint_wdtcsr;
+    #else
+        (void)enable;   //suppress unused warning
+    #endif
+}
+
+/**
+ * Starts the transaction at the head of the queue, if any
+ * and if the bus isn't in use already.
+ * Has to be called with interrupts disabled.
+ */
+static void twiint_startQueue(void)
+{
+    if(!twiint_head)
+    {
+        twiint_tail = NULL;
+    }
+    else if(!twiint_locked && !(TWCR & (1 << TWIE)))
+    {
+        twiint_watchdog(true);
+        TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+    }
+}
+
+void twiint_submit(Twiint_t *transaction)
+{
+    transaction->status = TWIINT_BUSY;
+    transaction->count = 0;
+    transaction->next = NULL;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if(twiint_head)
+        {
+            twiint_tail->next = transaction;
+            twiint_tail = transaction;
+        }
+        else
+        {
+            twiint_head = twiint_tail = transaction;
+            twiint_startQueue();
+        }
+    }
+}
+
+void twiint_setTransactionCallback(Twiint_t *transaction,
+    void (*callback)(Twiint_t *transaction), bool deferred)
+{
+    transaction->callback = callback;
+    transaction->deferred = deferred;
+}
+
+void twiint_lock(void)
+{
+    twiint_locked = true;
+}
+
+void twiint_unlock(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        twiint_locked = false;
+        twiint_startQueue();
+    }
+}
+
+
+
+#if TWIINT_STATS
+bool twiint_stats(uint8_t address, Twiint_stats_t *stats)
+{
+    uint8_t i;
+    
+    for(i=0; i<twiint_statsLen; i++)
+    {
+        if(twiint_statsTable[i].address == address)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                *stats = twiint_statsTable[i];
+            }
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+void twiint_clearStats(void)
+{
+    twiint_statsLen = 0;
+}
+
+/**
+ * Returns the statistics entry of an address,
+ * taking a new one if it isn't in the table yet.
+ * 
+ * @param address address of the slave (7-bit)
+ * @return the entry or NULL if the table is full
+ */
+static volatile Twiint_stats_t *twiint_statsEntry(uint8_t address)
+{
+    volatile Twiint_stats_t *entry;
+    uint8_t i;
+    
+    
+    for(i=0; i<twiint_statsLen; i++)
+        if(twiint_statsTable[i].address == address)
+            return &twiint_statsTable[i];
+    
+    if(twiint_statsLen >= TWIINT_STATS)
+        return NULL;
+    
+    entry = &twiint_statsTable[twiint_statsLen++];
+    entry->address = address;
+    entry->ok = entry->nacks = entry->arbLost = entry->errors = 0;
+    return entry;
+}
+#endif
+
+/**
+ * Counts an event of the running transaction in the statistics.
+ * 
+ * @param status the event, TWIINT_OK, a NACK, TWIINT_ARB_LOST or an error
+ */
+static void twiint_record(Twiint_status_t status)
+{
+    #if TWIINT_STATS
+        volatile Twiint_stats_t *entry;
+        
+        entry = twiint_statsEntry(twiint_head->address);
+        if(!entry)
+            return;
+        
+        switch(status)
+        {
+            case TWIINT_OK:
+                entry->ok++;
+                break;
+            case TWIINT_ADDRESS_NACK:
+            case TWIINT_DATA_NACK:
+                entry->nacks++;
+                break;
+            case TWIINT_ARB_LOST:
+                entry->arbLost++;
+                break;
+            default:
+                entry->errors++;
+        }
+    #else
+        (void)status;   //suppress unused warning
+    #endif
+}
+
+
+
+/** Calls the callback of a transaction, deferred version. */
+static void twiint_dispatch(void *transaction)
+{
+    ((Twiint_t*)transaction)->callback(transaction);
+}
+
+/**
+ * Records the status of the running transaction
+ * and chains the next one, sending STOP directly followed by START,
+ * or sends a STOP and disables the interrupt if there is none
+ * (or the queue is held).
+ * 
+ * @param status status of the finished transaction
+ */
+static void twiint_finish(Twiint_status_t status)
+{
+    Twiint_t *t = twiint_head;
+    
+    
+    twiint_record(status);
+    t->state = TW_STATUS;
+    twiint_nackRetries = twiint_arbRetries = 0;
+    
+    twiint_head = t->next;
+    if(twiint_head && !twiint_locked)
+    {
+        TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWSTA) | (1 << TWEN)
+            | (1 << TWIE);
+    }
+    else
+    {
+        TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
+        twiint_watchdog(false);
+    }
+    if(!twiint_head)
+        twiint_tail = NULL;
+    
+    t->status = status;
+    
+    //notify after the bus is busy again
+    if(t->callback)
+    {
+        if(t->deferred)
+            defer_post(twiint_dispatch, t);
+        else
+            t->callback(t);
+    }
+}
+
+
+
+bool twiint_flush(void)
+{
+    uint32_t i = 0;
+    uint8_t events = twiint_events;
+    bool ret = 0;
+    
+    
+    while(twiint_head)
+    {
+        //nothing can progress while held
+        if(twiint_locked && !twiint_isRunning())
+            return 1;
+        
+        if(events != twiint_events)
+        {
+            events = twiint_events;
+            i = 0;
+        }
+        else if(++i >= TWIINT_FLUSH_TIMEOUT)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                //no interrupt for the whole timeout, the bus is stuck
+                if(twiint_isRunning() && events == twiint_events)
+                {
+                    twi_recover();
+                    twiint_finish(TWIINT_TIMEOUT);
+                    ret = 1;
+                }
+            }
+            i = 0;
+        }
+        
+        _delay_us(1);
+    }
+    
+    return ret;
+}
+
+void twiint_tick(void)
+{
+    #if TWIINT_TIMEOUT_MS
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            if(!twiint_head || !(TWCR & (1 << TWIE))
+                    || twiint_events != twiint_tickEvents)
+            {
+                twiint_tickEvents = twiint_events;
+                twiint_idleTicks = 0;
+            }
+            else if(++twiint_idleTicks >= TWIINT_TIMEOUT_TICKS)
+            {
+                //no interrupt for TWIINT_TIMEOUT_MS, the bus is stuck
+                twi_recover();
+                twiint_finish(TWIINT_TIMEOUT);
+            }
+        }
+    #endif
 }
 
 
 
 ISR(TWI_vect)
 {
+    Twiint_t *t = twiint_head;
+    
+    
+    //the bus progressed
+    twiint_events++;
+    #if TWIINT_WATCHDOG
+        wdt_reset();
+    #endif
+    
     switch(TW_STATUS)
     {
         case TW_START:
+            //also after a lost arbitration, start over
+            twiint_index = 0;
+            t->count = 0;
+            TWDR = (t->outLen || !t->inLen) ? TWI_ADDRESS_W(t->address)
+                : TWI_ADDRESS_R(t->address);
+            TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
+            break;
+        
         case TW_REP_START:
+            //the same slave, now with read intend
             twiint_index = 0;
-            TWDR = twiint_address;
+            TWDR = TWI_ADDRESS_R(t->address);
             TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
             break;
         
         
-        case TW_MT_SLA_ACK:
         case TW_MT_DATA_ACK:
-            if(twiint_index < twiint_len)
+            t->count++;
+            //fall through
+        case TW_MT_SLA_ACK:
+            if(twiint_index < t->outLen)
             {
-                TWDR = twiint_data[twiint_index++];
+                TWDR = t->out[twiint_index++];
                 TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWIE);
             }
+            else if(t->inLen)
+            {
+                TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+            }
             else
             {
-                TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
+                twiint_finish(TWIINT_OK);
             }
             break;
         
         
         case TW_MR_DATA_ACK:
-            twiint_data[twiint_index++] = TWDR;
+            t->in[twiint_index++] = TWDR;
+            t->count++;
+            //fall through
         case TW_MR_SLA_ACK:
-            if(twiint_index < twiint_len-1)
+            if(twiint_index < t->inLen-1)
             {
                 TWCR = (1 << TWINT) | (1 << TWEA) | (1 << TWEN) | (1 << TWIE);
             }
@@ -165,23 +627,70 @@ ISR(TWI_vect)
             break;
         
         case TW_MR_DATA_NACK:
-            twiint_data[twiint_index++] = TWDR;
-            TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
+            t->in[twiint_index++] = TWDR;
+            t->count++;
+            twiint_finish(TWIINT_OK);
             break;
         
         
         
         case TW_MT_ARB_LOST:
         //case TW_MR_ARB_LOST:
-            TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+            //start over when the bus is free again
+            if(++twiint_arbRetries <= TWIINT_ARB_RETRIES)
+            {
+                twiint_record(TWIINT_ARB_LOST);
+                TWCR = (1 << TWINT) | (1 << TWSTA) | (1 << TWEN) | (1 << TWIE);
+            }
+            else
+            {
+                twiint_finish(TWIINT_ARB_LOST);
+            }
             break;
         
         
         
         case TW_MT_SLA_NACK:
-        case TW_MT_DATA_NACK:
         case TW_MR_SLA_NACK:
+            //release the bus for a moment and start over
+            if(++twiint_nackRetries <= TWIINT_NACK_RETRIES)
+            {
+                twiint_record(TWIINT_ADDRESS_NACK);
+                TWCR = (1 << TWINT) | (1 << TWSTO) | (1 << TWSTA)
+                    | (1 << TWEN) | (1 << TWIE);
+            }
+            else
+            {
+                twiint_finish(TWIINT_ADDRESS_NACK);
+            }
+            break;
+        
+        //a partly written transaction isn't repeated
+        case TW_MT_DATA_NACK:
+            twiint_finish(TWIINT_DATA_NACK);
+            break;
+        
+        case TW_BUS_ERROR:
+            twiint_finish(TWIINT_BUS_ERROR);
+            break;
+        
         default:
-            TWCR = (1 << TWINT) | (1 << TWEN) | (1 << TWSTO);
+            twiint_finish(TWIINT_ERROR);
     }
 }
+
+#if TWIINT_WATCHDOG
+ISR(WDT_vect)
+{
+    //completed in the meantime
+    if(!twiint_head || !(TWCR & (1 << TWIE)))
+    {
+        twiint_watchdog(false);
+        return;
+    }
+    
+    //no interrupt for a whole period, the bus is stuck
+    twi_recover();
+    twiint_finish(TWIINT_TIMEOUT);
+}
+#endif
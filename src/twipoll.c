@@ -0,0 +1,170 @@
+/*
+ * twipoll.c
+ * 
+ * Background I2C register polling on twiint
+ * (double buffered shadow copies with timestamps).
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <util/atomic.h>    //atomic blocks
+#include "twiint.h"
+#include "twipoll.h"
+
+
+
+/** Added blocks. */
+static Twipoll_t *volatile twipoll_blocks = NULL;
+/** Ticks since twipoll_init. */
+static volatile uint16_t twipoll_ticks = 0;
+
+
+
+void twipoll_init(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        twipoll_blocks = NULL;
+        twipoll_ticks = 0;
+    }
+}
+
+Twipoll_t twipoll_initBlock(uint8_t address, uint8_t reg,
+    uint8_t *buf, uint8_t len, uint16_t period, uint16_t offset)
+{
+    return (Twipoll_t){.transaction = TWIINT_INIT(address, NULL, 0, NULL, 0),
+        .address = address, .reg = reg, .len = len, .buf = buf,
+        .period = period, .countdown = offset, .front = 0, .fresh = false,
+        .timestamp = 0, .errors = 0, .next = NULL};
+}
+
+void twipoll_add(Twipoll_t *block)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        block->next = twipoll_blocks;
+        twipoll_blocks = block;
+    }
+}
+
+
+
+/**
+ * Swaps the copies of a block when its poll completed successfully.
+ * 
+ * @param transaction transaction of the block
+ */
+static void twipoll_done(Twiint_t *transaction)
+{
+    //the transaction is the first member of the block
+    Twipoll_t *block = (Twipoll_t*)transaction;
+    
+    if(transaction->status == TWIINT_OK)
+    {
+        block->front ^= 1;
+        block->fresh = true;
+        block->timestamp = twipoll_ticks;
+    }
+    else
+    {
+        block->errors++;
+    }
+}
+
+void twipoll_tick(void)
+{
+    Twipoll_t *block;
+    
+    
+    //read by the completion callback in the TWI interrupt
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        twipoll_ticks++;
+    }
+    
+    for(block=twipoll_blocks; block; block=block->next)
+    {
+        if(block->countdown && --block->countdown)
+            continue;
+        //still running, try again on the next tick
+        if(block->transaction.status == TWIINT_BUSY)
+            continue;
+        
+        block->countdown = block->period;
+        //read into the copy that isn't the snapshot
+        block->transaction = twiint_initTransaction(block->address,
+            &block->reg, 1, block->buf + (block->front ^ 1) * block->len,
+            block->len);
+        twiint_setTransactionCallback(&block->transaction, twipoll_done,
+            false);
+        twiint_submit(&block->transaction);
+    }
+}
+
+uint16_t twipoll_now(void)
+{
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = twipoll_ticks;
+    }
+    
+    return ret;
+}
+
+
+
+uint16_t twipoll_read(Twipoll_t *block, void *data)
+{
+    uint8_t *bytes = data, *copy, i;
+    uint16_t ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        copy = block->buf + block->front * block->len;
+        for(i=0; i<block->len; i++)
+            bytes[i] = copy[i];
+        block->fresh = false;
+        ret = block->timestamp;
+    }
+    
+    return ret;
+}
+
+bool twipoll_isFresh(const Twipoll_t *block)
+{
+    return block->fresh;
+}
+
+Twiint_status_t twipoll_status(const Twipoll_t *block)
+{
+    return block->transaction.status;
+}
@@ -0,0 +1,297 @@
+/*
+ * twislave.c
+ * 
+ * Interrupt based I2C slave emulating a register map.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <avr/io.h>         //hardware registers
+#include <avr/interrupt.h>  //interrupt vectors
+#include <util/twi.h>       //TWI status masks
+#include <util/atomic.h>    //atomic blocks
+#include "twislave.h"
+
+
+
+#if TWISLAVE_REGS < 1 || TWISLAVE_REGS > 256
+    #error "TWISLAVE_REGS out of range!"
+#endif
+
+/** Advances the register pointer, wrapping around. */
+#if TWISLAVE_REGS < 256
+    #define TWISLAVE_NEXT(p) do { if(++(p) >= TWISLAVE_REGS) (p) = 0; } \
+        while(0)
+#else
+    #define TWISLAVE_NEXT(p) ((p)++)
+#endif
+
+/** Wraps a register number of the application into the map. */
+#if TWISLAVE_REGS < 256
+    #define TWISLAVE_WRAP(p) ((uint8_t)((p) % TWISLAVE_REGS))
+#else
+    #define TWISLAVE_WRAP(p) (p)
+#endif
+
+/** Tests a register bit in a bitmap. */
+#define TWISLAVE_TEST(bitmap, p) ((bitmap)[(p) >> 3] & twislave_bits[(p) & 7])
+
+/** Acknowledge and wait for the next event. */
+#define TWISLAVE_ACK \
+    ((1 << TWINT) | (1 << TWEA) | (1 << TWEN) | (1 << TWIE))
+
+
+
+/** Bit masks, a table is faster than a variable shift. */
+static const uint8_t twislave_bits[8] = {0x01, 0x02, 0x04, 0x08,
+    0x10, 0x20, 0x40, 0x80};
+
+/** The register map. */
+static volatile uint8_t twislave_regs[TWISLAVE_REGS];
+/** Registers the host can't write/read. */
+static volatile uint8_t twislave_readOnly[TWISLAVE_BITMAP_LEN],
+    twislave_writeOnly[TWISLAVE_BITMAP_LEN];
+/** Registers written by the host in the current transaction
+ * and in completed ones (not taken yet). */
+static volatile uint8_t twislave_pending[TWISLAVE_BITMAP_LEN],
+    twislave_changed[TWISLAVE_BITMAP_LEN];
+/** Register pointer. */
+static volatile uint8_t twislave_pointer = 0;
+/** If the next received byte is the register pointer. */
+static volatile bool twislave_first;
+/** If the host is addressing the slave. */
+static volatile bool twislave_busy = false;
+
+
+
+void twislave_init(void)
+{
+    uint16_t i;
+    
+    
+    for(i=0; i<TWISLAVE_REGS; i++)
+        twislave_regs[i] = 0;
+    for(i=0; i<TWISLAVE_BITMAP_LEN; i++)
+        twislave_readOnly[i] = twislave_writeOnly[i] = twislave_pending[i]
+            = twislave_changed[i] = 0;
+    twislave_pointer = 0;
+    twislave_busy = false;
+    
+    TWAR = TWISLAVE_ADDRESS << 1;
+    TWCR = TWISLAVE_ACK;
+}
+
+void twislave_setAccess(uint8_t reg, uint16_t len, Twislave_access_t access)
+{
+    uint8_t bit;
+    
+    reg = TWISLAVE_WRAP(reg);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        while(len--)
+        {
+            bit = twislave_bits[reg & 7];
+            twislave_readOnly[reg >> 3] &= ~bit;
+            twislave_writeOnly[reg >> 3] &= ~bit;
+            if(access == TWISLAVE_RO)
+                twislave_readOnly[reg >> 3] |= bit;
+            else if(access == TWISLAVE_WO)
+                twislave_writeOnly[reg >> 3] |= bit;
+            TWISLAVE_NEXT(reg);
+        }
+    }
+}
+
+bool twislave_isBusy(void)
+{
+    return twislave_busy;
+}
+
+
+
+void twislave_write(uint8_t reg, const void *data, uint8_t len)
+{
+    const uint8_t *bytes = data;
+    
+    reg = TWISLAVE_WRAP(reg);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        while(len--)
+        {
+            twislave_regs[reg] = *bytes++;
+            TWISLAVE_NEXT(reg);
+        }
+    }
+}
+
+void twislave_read(uint8_t reg, void *data, uint8_t len)
+{
+    uint8_t *bytes = data;
+    
+    reg = TWISLAVE_WRAP(reg);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        while(len--)
+        {
+            *bytes++ = twislave_regs[reg];
+            TWISLAVE_NEXT(reg);
+        }
+    }
+}
+
+void twislave_set(uint8_t reg, uint8_t value)
+{
+    twislave_regs[TWISLAVE_WRAP(reg)] = value;
+}
+
+uint8_t twislave_get(uint8_t reg)
+{
+    return twislave_regs[TWISLAVE_WRAP(reg)];
+}
+
+
+
+bool twislave_takeChange(uint8_t reg)
+{
+    bool ret;
+    
+    reg = TWISLAVE_WRAP(reg);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = TWISLAVE_TEST(twislave_changed, reg);
+        twislave_changed[reg >> 3] &= ~twislave_bits[reg & 7];
+    }
+    
+    return ret;
+}
+
+bool twislave_takeChanges(uint8_t *bitmap)
+{
+    uint8_t i, any = 0;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for(i=0; i<TWISLAVE_BITMAP_LEN; i++)
+        {
+            any |= bitmap[i] = twislave_changed[i];
+            twislave_changed[i] = 0;
+        }
+    }
+    
+    return any;
+}
+
+
+
+ISR(TWI_vect)
+{
+    uint8_t p = twislave_pointer, data, i;
+    
+    
+    switch(TW_STATUS)
+    {
+        //own address with write intend, the pointer follows
+        case TW_SR_SLA_ACK:
+        case TW_SR_ARB_LOST_SLA_ACK:
+            twislave_first = true;
+            twislave_busy = true;
+            TWCR = TWISLAVE_ACK;
+            break;
+        
+        case TW_SR_DATA_ACK:
+            //release the clock first
+            data = TWDR;
+            TWCR = TWISLAVE_ACK;
+            
+            if(twislave_first)
+            {
+                p = data;
+                #if TWISLAVE_REGS < 256
+                    if(p >= TWISLAVE_REGS)
+                        p %= TWISLAVE_REGS;
+                #endif
+                twislave_first = false;
+            }
+            else
+            {
+                if(!TWISLAVE_TEST(twislave_readOnly, p))
+                {
+                    twislave_regs[p] = data;
+                    twislave_pending[p >> 3] |= twislave_bits[p & 7];
+                }
+                TWISLAVE_NEXT(p);
+            }
+            twislave_pointer = p;
+            break;
+        
+        //STOP or repeated START, the written registers are complete
+        case TW_SR_STOP:
+            //release the bus first
+            TWCR = TWISLAVE_ACK;
+            twislave_busy = false;
+            for(i=0; i<TWISLAVE_BITMAP_LEN; i++)
+            {
+                twislave_changed[i] |= twislave_pending[i];
+                twislave_pending[i] = 0;
+            }
+            break;
+        
+        
+        //own address with read intend or next byte,
+        //reading starts at the pointer
+        case TW_ST_SLA_ACK:
+        case TW_ST_ARB_LOST_SLA_ACK:
+            twislave_busy = true;
+            //fall through
+        case TW_ST_DATA_ACK:
+            TWDR = (TWISLAVE_TEST(twislave_writeOnly, p)) ? TWISLAVE_FILL
+                : twislave_regs[p];
+            TWCR = TWISLAVE_ACK;
+            TWISLAVE_NEXT(p);
+            twislave_pointer = p;
+            break;
+        
+        //host doesn't want more bytes
+        case TW_ST_DATA_NACK:
+        case TW_ST_LAST_DATA:
+            twislave_busy = false;
+            TWCR = TWISLAVE_ACK;
+            break;
+        
+        
+        case TW_BUS_ERROR:
+            twislave_busy = false;
+            TWCR = TWISLAVE_ACK | (1 << TWSTO);
+            break;
+        
+        default:
+            TWCR = TWISLAVE_ACK;
+    }
+}
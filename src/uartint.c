@@ -34,6 +34,7 @@
 
 #include <avr/io.h>         //hardware registers
 #include <avr/interrupt.h>  //interrupt vectors
+#include <avr/sleep.h>      //sleep modes
 #include <util/atomic.h>    //atomic blocks
 #include "ring.h"           //buffers
 #include "uartint.h"
@@ -86,6 +87,24 @@ static volatile Ring_t uartint_transmitBuf, uartint_receiveBuf;
 static volatile uint8_t uartint_transmitArray[UARTINT_BUF_LEN],
     uartint_receiveArray[UARTINT_BUF_LEN];
 
+#ifdef UARTINT_WAKE
+/** If a byte has been written to UDR0 since the last sleep. */
+static volatile bool uartint_sent = false;
+
+/** Receiver state after waking up. */
+static volatile enum
+{
+    /** Receiving normally. */
+    UARTINT_AWAKE,
+    /** Woken up, discard the next byte if it has a framing error. */
+    UARTINT_WOKEN,
+    /** Woken up, discard until the preamble has been received. */
+    UARTINT_WAIT_PREAMBLE,
+    /** Preamble received, discard further preamble bytes. */
+    UARTINT_SKIP_PREAMBLE
+} uartint_wakeState = UARTINT_AWAKE;
+#endif
+
 
 
 void uartint_init(void)
@@ -158,15 +177,37 @@ size_t uartint_transmitAvailable(void)
 
 void uartint_transmitFlush(void)
 {
-    bool empty;
-    
-    do
-    {
-        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    #ifdef UARTINT_NO_SLEEP
+        bool empty;
+        
+        do
         {
-            empty = ring_isEmpty(uartint_transmitBuf);
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                empty = ring_isEmpty(uartint_transmitBuf);
+            }
+        } while(!empty);
+    #else
+        uint8_t sreg = SREG, smcr = SMCR;
+        
+        //sleep until the UDRE interrupt emptied the buffer
+        set_sleep_mode(SLEEP_MODE_IDLE);
+        cli();
+        while(!ring_isEmpty(uartint_transmitBuf))
+        {
+            sleep_enable();
+            //the instruction after sei is executed before any interrupt,
+            //so no interrupt can sneak in between the check and sleeping
+            sei();
+            sleep_cpu();
+            sleep_disable();
+            cli();
         }
-    } while(!empty);
+        
+        //leave the sleep mode and interrupt flag of the application
+        SMCR = smcr;
+        SREG = sreg;
+    #endif
 }
 
 bool uartint_transmit(uint8_t data)
@@ -200,6 +241,21 @@ size_t uartint_transmitBurst(uint8_t *data, size_t len)
     return i;
 }
 
+bool uartint_transmitTry(uint8_t *data, size_t len)
+{
+    bool ret;
+    
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ret = ring_pushBurst((Ring_t*)&uartint_transmitBuf, data, len);
+    }
+    
+    if(!ret)
+        UCSR0B |= (1 << UDRIE0);
+    
+    return ret;
+}
+
 
 size_t uartint_receiveAvailable(void)
 {
@@ -249,12 +305,72 @@ size_t uartint_receiveBurst(uint8_t* data, size_t len)
 
 
 
+#ifdef UARTINT_WAKE
+void uartint_sleep(void)
+{
+    uint8_t smcr;
+    
+    
+    //the USART stops in most sleep modes,
+    //so let the last byte leave the shift register as well
+    uartint_transmitFlush();
+    if(uartint_sent)
+    {
+        while(~UCSR0A & (1 << TXC0))
+            ;
+        uartint_sent = false;
+    }
+    
+    
+    cli();
+    if(ring_isEmpty(uartint_receiveBuf))
+    {
+        #ifdef UARTINT_PREAMBLE
+            uartint_wakeState = UARTINT_WAIT_PREAMBLE;
+        #else
+            uartint_wakeState = UARTINT_WOKEN;
+        #endif
+        
+        //wake up on the start bit
+        PCMSK2 |= (1 << PCINT16);
+        PCIFR = (1 << PCIF2);
+        PCICR |= (1 << PCIE2);
+        
+        smcr = SMCR;
+        set_sleep_mode(UARTINT_SLEEP_MODE);
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        
+        //no more wake-ups on RXD while awake
+        cli();
+        //woken up by another interrupt, no RXD activity to recover from
+        if((PCICR & (1 << PCIE2)) && !(PCIFR & (1 << PCIF2)))
+            uartint_wakeState = UARTINT_AWAKE;
+        PCICR &= ~(1 << PCIE2);
+        PCMSK2 &= ~(1 << PCINT16);
+        SMCR = smcr;
+    }
+    sei();
+}
+#endif
+
+
+
 ISR(USART_UDRE_vect)
 {
     uint8_t c;
     
     if(!ring_pop((Ring_t*)&uartint_transmitBuf, &c))
+    {
+        #ifdef UARTINT_WAKE
+            //clear TXC0 so uartint_sleep can wait for the last byte
+            UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0);
+            uartint_sent = true;
+        #endif
         UDR0 = c;
+    }
     //stop transmitter when there is not data to be transmitted
     else
         UCSR0B &= ~(1 << UDRIE0);
@@ -262,9 +378,56 @@ ISR(USART_UDRE_vect)
 
 ISR(USART_RX_vect)
 {
+    #ifdef UARTINT_WAKE
+        //status has to be read before the data
+        bool error = UCSR0A & ((1 << FE0) | (1 << DOR0));
+    #endif
+    uint8_t c = UDR0;
+    
+    
+    #ifdef UARTINT_WAKE
+        switch(uartint_wakeState)
+        {
+            case UARTINT_AWAKE:
+                break;
+            
+            case UARTINT_WOKEN:
+                uartint_wakeState = UARTINT_AWAKE;
+                if(error)
+                    return;
+                break;
+            
+            #ifdef UARTINT_PREAMBLE
+            case UARTINT_WAIT_PREAMBLE:
+                if(!error && c == UARTINT_PREAMBLE)
+                    uartint_wakeState = UARTINT_SKIP_PREAMBLE;
+                return;
+            
+            case UARTINT_SKIP_PREAMBLE:
+                if(error || c == UARTINT_PREAMBLE)
+                    return;
+                uartint_wakeState = UARTINT_AWAKE;
+                break;
+            #endif
+            
+            default:
+                uartint_wakeState = UARTINT_AWAKE;
+        }
+    #endif
+    
     #ifdef UARTINT_OVERWRITE
-        ring_pushOver((Ring_t*)&uartint_receiveBuf, UDR0);
+        ring_pushOver((Ring_t*)&uartint_receiveBuf, c);
     #else
-        ring_push((Ring_t*)&uartint_receiveBuf, UDR0);
+        ring_push((Ring_t*)&uartint_receiveBuf, c);
     #endif
 }
+
+#ifdef UARTINT_WAKE
+//RXD activity while sleeping
+ISR(PCINT2_vect)
+{
+    //the USART takes over from here
+    PCICR &= ~(1 << PCIE2);
+    PCMSK2 &= ~(1 << PCINT16);
+}
+#endif
@@ -0,0 +1,75 @@
+/*
+ * binlog_test.c
+ * 
+ * binlog.h example.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#define BINLOG_FILE_ID 1
+
+#include <avr/interrupt.h>
+#include <util/delay.h>
+#include "adc.h"
+#include "binlog.h"
+#include "uartint.h"
+
+
+
+void init(void);
+
+int main(void)
+{
+    uint8_t i;
+    
+    
+    
+    init();
+    
+    //decode on the host with
+    //tools/binlog table binlog_test.c > binlog.txt
+    //tools/binlog decode binlog.txt < /dev/ttyACM0
+    BINLOG0("Started\n");
+    
+    while(1)
+    {
+        for(i=0; i<ADC_N; i++)
+            BINLOG2("ADC%hhu: %4u\n", i, adc_get(i));
+        BINLOG1("Dropped: %u\n", binlog_dropped());
+        _delay_ms(250);
+    }
+}
+
+void init(void)
+{
+    uartint_init();
+    adc_init();
+    sei();
+}
@@ -0,0 +1,69 @@
+/*
+ * mspim_test.c
+ * 
+ * mspim.h example.
+ * Sends out all numbers between 0 and 0xFF over the USART in SPI mode
+ * and prints them to the software UART with the corresponding responses.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <stdio.h>
+#include <avr/interrupt.h>
+#include "mspim.h"
+#include "suart.h"
+
+
+
+void init(void);
+
+int main(void)
+{
+    uint16_t byte;
+    
+    
+    
+    init();
+    
+    fprintf(&suart_out, "Sent : Received\n");
+    for(byte=0x00; byte<=0xFF; byte++)
+        fprintf(&suart_out, "0x%02X : 0x%02X\n",
+            (uint8_t)byte, mspim_writeRead(byte));
+    
+    while(1)
+        ;
+}
+
+void init(void)
+{
+    suart_init();
+    mspim_init();
+    sei();
+}
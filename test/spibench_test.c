@@ -0,0 +1,129 @@
+/*
+ * spibench_test.c
+ * 
+ * spi.h burst benchmark.
+ * Times the burst functions with timer 1 at every prescaler
+ * and prints the achieved bytes/s next to the wire rate
+ * and to a byte by byte spi_writeRead loop.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <stdio.h>
+#include <avr/io.h>
+#include "spi.h"
+#include "uart.h"
+
+
+
+//default to Arduino oscillator
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+    #warning "F_CPU not defined! Assuming 16MHz."
+#endif
+
+//bytes per burst, 48 bytes at prescaler 128 fit into 16 bit cycles
+#define SPIBENCH_LEN 48
+
+
+
+void init(void);
+void timerStart(void);
+uint16_t timerStop(void);
+void print(const char *name, uint16_t cycles);
+
+int main(void)
+{
+    uint8_t out[SPIBENCH_LEN], in[SPIBENCH_LEN];
+    uint16_t prescaler;
+    size_t i;
+    
+    
+    
+    init();
+    
+    for(i=0; i<SPIBENCH_LEN; i++)
+        out[i] = i;
+    
+    for(prescaler=2; prescaler<=128; prescaler*=2)
+    {
+        spi_setConfig(spi_initConfig(F_CPU/prescaler, 0, 0));
+        printf("Prescaler %3u, wire %7lu B/s\n",
+            prescaler, F_CPU/prescaler/8);
+        
+        timerStart();
+        for(i=0; i<SPIBENCH_LEN; i++)
+            spi_writeRead(out[i]);
+        print("writeRead loop", timerStop());
+        
+        timerStart();
+        spi_writeBurst(out, SPIBENCH_LEN);
+        print("writeBurst", timerStop());
+        
+        timerStart();
+        spi_readBurst(in, SPIBENCH_LEN);
+        print("readBurst", timerStop());
+        
+        timerStart();
+        spi_writeReadBurst(out, in, SPIBENCH_LEN);
+        print("writeReadBurst", timerStop());
+    }
+    
+    while(1)
+        ;
+}
+
+void init(void)
+{
+    uart_init();
+    spi_init();
+}
+
+void timerStart(void)
+{
+    //timer 1 without prescaler counts CPU cycles
+    TCCR1A = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+    TCCR1B = (1 << CS10);
+}
+
+uint16_t timerStop(void)
+{
+    TCCR1B = 0;
+    
+    return TCNT1;
+}
+
+void print(const char *name, uint16_t cycles)
+{
+    printf("  %-15s %5u cycles, %7lu B/s\n", name, cycles,
+        (uint32_t)SPIBENCH_LEN*F_CPU/cycles);
+}
@@ -0,0 +1,100 @@
+/*
+ * spislave_test.c
+ * 
+ * spislave.h example.
+ * Echoes every received frame back to the host and prints the received
+ * bytes per second and the error counters to the UART every second.
+ * Raise the host's clock until the counters increase
+ * to find the maximum sustained rate.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "spislave.h"
+#include "uart.h"
+
+
+
+//default to Arduino oscillator
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+    #warning "F_CPU not defined! Assuming 16MHz."
+#endif
+
+
+
+void init(void);
+
+int main(void)
+{
+    uint8_t frame[SPISLAVE_BUF_LEN];
+    size_t len;
+    uint32_t bytes = 0;
+    
+    
+    
+    init();
+    
+    while(1)
+    {
+        if(spislave_frameAvailable())
+        {
+            len = spislave_receiveFrame(frame, sizeof(frame));
+            bytes += len;
+            if(len > sizeof(frame))
+                len = sizeof(frame);
+            spislave_transmitTry(frame, len);
+        }
+        
+        //one second passed
+        if(TIFR1 & (1 << OCF1A))
+        {
+            TIFR1 = (1 << OCF1A);
+            printf("%lu B/s, %u underruns, %u overflows\n",
+                bytes, spislave_underruns(), spislave_overflows());
+            bytes = 0;
+        }
+    }
+}
+
+void init(void)
+{
+    uart_init();
+    spislave_init();
+    
+    //timer 1 CTC, one compare match per second
+    OCR1A = F_CPU/256 - 1;
+    TCCR1B = (1 << WGM12) | (1 << CS12);
+    
+    sei();
+}
@@ -0,0 +1,97 @@
+/*
+ * twislave_test.c
+ * 
+ * twislave.h example.
+ * Emulates a small device: registers 0-3 count the seconds (read only),
+ * 4-7 are scratch registers and 8 is a write only command register.
+ * Every register written by the host is printed to the UART.
+ * 
+ * Author:      Sebastian Goessl
+ * Hardware:    ATmega328P
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+
+#include <stdio.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "twislave.h"
+#include "uart.h"
+
+
+
+//default to Arduino oscillator
+#ifndef F_CPU
+    #define F_CPU 16000000UL
+    #warning "F_CPU not defined! Assuming 16MHz."
+#endif
+
+
+
+void init(void);
+
+int main(void)
+{
+    uint8_t changes[TWISLAVE_BITMAP_LEN];
+    uint32_t seconds = 0;
+    uint16_t i;
+    
+    
+    
+    init();
+    
+    while(1)
+    {
+        if(twislave_takeChanges(changes))
+            for(i=0; i<TWISLAVE_REGS; i++)
+                if(changes[i/8] & (1 << (i%8)))
+                    printf("register %u = 0x%02X\n", i, twislave_get(i));
+        
+        //one second passed
+        if(TIFR1 & (1 << OCF1A))
+        {
+            TIFR1 = (1 << OCF1A);
+            seconds++;
+            twislave_write(0, &seconds, sizeof(seconds));
+        }
+    }
+}
+
+void init(void)
+{
+    uart_init();
+    twislave_init();
+    twislave_setAccess(0, 4, TWISLAVE_RO);
+    twislave_setAccess(8, 1, TWISLAVE_WO);
+    
+    //timer 1 CTC, one compare match per second
+    OCR1A = F_CPU/256 - 1;
+    TCCR1B = (1 << WGM12) | (1 << CS12);
+    
+    sei();
+}
@@ -0,0 +1,550 @@
+/*
+ * binlog.c
+ * 
+ * Host side table generator and decoder for binlog.h records.
+ * 
+ * Author:      Sebastian Goessl
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+/*
+ * Build with the makefile in this folder (native compiler, not avr-gcc).
+ * 
+ * Generate the table at build time from every source file that logs:
+ *     ./binlog table main.c sensor.c > binlog.txt
+ * Decode a captured stream (e.g. straight from the serial port):
+ *     ./binlog decode binlog.txt < /dev/ttyACM0
+ */
+
+
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/** Number of log site ID bits used for the line number (see binlog.h). */
+#define BINLOG_LINE_BITS 12
+/** Number of bytes in front of the argument bytes (see binlog.h). */
+#define BINLOG_HEADER_LEN 3
+/** Maximum length of a single format string. */
+#define BINLOG_FORMAT_MAX 256
+/** Number of possible log site IDs. */
+#define BINLOG_IDS 0x10000
+
+
+
+/** Format strings by log site ID, unescaped. */
+static char *binlog_formats[BINLOG_IDS];
+
+
+
+/**
+ * Reads a whole file into a \0 terminated string.
+ * 
+ * @param path file to read
+ * @return the file contents or NULL on failure
+ */
+static char *binlog_readFile(const char *path)
+{
+    FILE *f;
+    long len;
+    char *s;
+    
+    
+    if(!(f = fopen(path, "rb")))
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    
+    if(len < 0 || !(s = malloc(len + 1)))
+    {
+        fclose(f);
+        return NULL;
+    }
+    len = fread(s, 1, len, f);
+    s[len] = '\0';
+    fclose(f);
+    
+    return s;
+}
+
+/**
+ * Returns if c can be part of an identifier.
+ */
+static int binlog_isIdent(char c)
+{
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/**
+ * Skips whitespace and comments, counting newlines.
+ * 
+ * @param p current position
+ * @param line line counter to update
+ * @return first position that is neither whitespace nor comment
+ */
+static const char *binlog_skipSpace(const char *p, unsigned long *line)
+{
+    while(*p)
+    {
+        if(*p == '\n')
+        {
+            (*line)++;
+            p++;
+        }
+        else if(isspace((unsigned char)*p))
+            p++;
+        else if(p[0] == '/' && p[1] == '/')
+            while(*p && *p != '\n')
+                p++;
+        else if(p[0] == '/' && p[1] == '*')
+        {
+            for(p+=2; *p && !(p[0] == '*' && p[1] == '/'); p++)
+                if(*p == '\n')
+                    (*line)++;
+            if(*p)
+                p += 2;
+        }
+        else
+            break;
+    }
+    
+    return p;
+}
+
+/**
+ * Skips a string or character literal, keeping its content
+ * (escapes unprocessed) if a destination is given.
+ * 
+ * @param p opening quote
+ * @param dst location to append the content to or NULL
+ * @param len current length of the content in dst, updated
+ * @return position after the closing quote
+ */
+static const char *binlog_skipLiteral(const char *p, char *dst, size_t *len)
+{
+    char quote = *p++;
+    
+    while(*p && *p != quote && *p != '\n')
+    {
+        if(*p == '\\' && p[1])
+        {
+            if(dst && *len+2 < BINLOG_FORMAT_MAX)
+            {
+                dst[(*len)++] = p[0];
+                dst[(*len)++] = p[1];
+            }
+            p += 2;
+        }
+        else
+        {
+            if(dst && *len+1 < BINLOG_FORMAT_MAX)
+                dst[(*len)++] = *p;
+            p++;
+        }
+    }
+    if(dst)
+        dst[*len] = '\0';
+    
+    return (*p == quote) ? p+1 : p;
+}
+
+/**
+ * Prints the table entries of all log sites in a source file.
+ * 
+ * @param path source file
+ * @return number of log sites found or -1 if the file couldn't be read
+ */
+static int binlog_table(const char *path)
+{
+    char *src, *def;
+    const char *p;
+    unsigned long line = 1, site;
+    long file = 0;
+    int n = 0;
+    char format[BINLOG_FORMAT_MAX];
+    size_t len;
+    
+    
+    if(!(src = binlog_readFile(path)))
+        return -1;
+    
+    if((def = strstr(src, "#define BINLOG_FILE_ID")))
+        file = strtol(def + strlen("#define BINLOG_FILE_ID"), NULL, 0);
+    
+    
+    p = src;
+    while(*p)
+    {
+        if(*p == '"' || *p == '\'')
+            p = binlog_skipLiteral(p, NULL, NULL);
+        else if((p[0] == '/' && (p[1] == '/' || p[1] == '*'))
+                || isspace((unsigned char)*p))
+            p = binlog_skipSpace(p, &line);
+        else if(!strncmp(p, "BINLOG", 6) && p[6] >= '0' && p[6] <= '4'
+                && !binlog_isIdent(p[7])
+                && (p == src || !binlog_isIdent(p[-1])))
+        {
+            //__LINE__ expands to the line of the macro name
+            site = line;
+            p = binlog_skipSpace(p+7, &line);
+            if(*p != '(')
+                continue;
+            p = binlog_skipSpace(p+1, &line);
+            
+            //concatenate adjacent literals
+            len = 0;
+            format[0] = '\0';
+            if(*p != '"')
+                continue;
+            while(*p == '"')
+            {
+                p = binlog_skipLiteral(p, format, &len);
+                p = binlog_skipSpace(p, &line);
+            }
+            
+            if(site >> BINLOG_LINE_BITS)
+                fprintf(stderr, "%s:%lu: warning: line number too large, "
+                    "the log site ID is ambiguous\n", path, site);
+            printf("0x%04lX\t%s:%lu\t%s\n",
+                ((unsigned long)file << BINLOG_LINE_BITS)
+                | (site & ((1UL << BINLOG_LINE_BITS) - 1)),
+                path, site, format);
+            n++;
+        }
+        else if(binlog_isIdent(*p))
+            while(binlog_isIdent(*p))
+                p++;
+        else
+            p++;
+    }
+    
+    free(src);
+    return n;
+}
+
+
+
+/**
+ * Replaces C escape sequences in place.
+ * 
+ * @param s string to unescape
+ */
+static void binlog_unescape(char *s)
+{
+    char *d = s;
+    
+    while(*s)
+    {
+        if(*s != '\\' || !s[1])
+        {
+            *d++ = *s++;
+            continue;
+        }
+        
+        s++;
+        switch(*s)
+        {
+            case 'n': *d++ = '\n'; s++; break;
+            case 'r': *d++ = '\r'; s++; break;
+            case 't': *d++ = '\t'; s++; break;
+            case '0': case '1': case '2': case '3':
+            case '4': case '5': case '6': case '7':
+                *d++ = (char)strtol(s, &s, 8);
+                break;
+            case 'x':
+                *d++ = (char)strtol(s+1, &s, 16);
+                break;
+            default: *d++ = *s++;
+        }
+    }
+    *d = '\0';
+}
+
+/**
+ * Loads a table generated by binlog_table.
+ * 
+ * @param path table file
+ * @return number of entries loaded or -1 if the file couldn't be read
+ */
+static int binlog_load(const char *path)
+{
+    FILE *f;
+    char line[2*BINLOG_FORMAT_MAX], *format;
+    unsigned long id;
+    int n = 0;
+    
+    
+    if(!(f = fopen(path, "r")))
+        return -1;
+    
+    while(fgets(line, sizeof(line), f))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        //ID, location, format
+        id = strtoul(line, NULL, 0);
+        if(id >= BINLOG_IDS || !(format = strchr(line, '\t'))
+                || !(format = strchr(format+1, '\t')))
+            continue;
+        
+        free(binlog_formats[id]);
+        binlog_formats[id] = strdup(format+1);
+        binlog_unescape(binlog_formats[id]);
+        n++;
+    }
+    
+    fclose(f);
+    return n;
+}
+
+/**
+ * Parses the next conversion specification.
+ * 
+ * @param p location after the '%'
+ * @param spec location for the specification without length modifiers
+ * @param conv location for the conversion character
+ * @return number of argument bytes on the device (AVR: int is 16 bit,
+ * float and double are 32 bit), 0 for "%%" or -1 if not supported
+ */
+static int binlog_parseSpec(const char **p, char *spec, char *conv)
+{
+    int size = 2;
+    size_t len = 0;
+    
+    
+    spec[len++] = '%';
+    while(**p && strchr("-+ #0123456789.", **p) && len < 16)
+        spec[len++] = *(*p)++;
+    spec[len] = '\0';
+    
+    if(**p == 'h')
+    {
+        (*p)++;
+        if(**p == 'h')
+        {
+            (*p)++;
+            size = 1;
+        }
+    }
+    else if(**p == 'l')
+    {
+        (*p)++;
+        size = 4;
+    }
+    
+    *conv = *(*p)++;
+    switch(*conv)
+    {
+        case '%': return 0;
+        case 'c': return 1;
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+            return size;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+            return 4;
+        default: return -1;
+    }
+}
+
+/**
+ * Returns the number of argument bytes a format string expects.
+ * 
+ * @param format format string
+ * @return number of argument bytes or -1 if not supported
+ */
+static int binlog_argsLen(const char *format)
+{
+    char spec[32], conv;
+    int len = 0, size;
+    
+    while(*format)
+        if(*format++ == '%')
+        {
+            if((size = binlog_parseSpec(&format, spec, &conv)) < 0)
+                return -1;
+            len += size;
+        }
+    
+    return len;
+}
+
+/**
+ * Prints a record.
+ * 
+ * @param format format string of the log site
+ * @param args argument bytes (little endian)
+ */
+static void binlog_print(const char *format, const uint8_t *args)
+{
+    char spec[40], conv;
+    int size, i;
+    uint32_t raw;
+    long long value;
+    float f;
+    
+    
+    while(*format)
+    {
+        if(*format != '%')
+        {
+            putchar(*format++);
+            continue;
+        }
+        format++;
+        
+        size = binlog_parseSpec(&format, spec, &conv);
+        if(size == 0)
+        {
+            putchar('%');
+            continue;
+        }
+        
+        for(raw=0, i=size-1; i>=0; i--)
+            raw = (raw << 8) | args[i];
+        args += size;
+        
+        if(strchr("fFeEgG", conv))
+        {
+            memcpy(&f, &raw, sizeof(f));
+            strncat(spec, &conv, 1);
+            printf(spec, (double)f);
+        }
+        else if(conv == 'c')
+        {
+            strcat(spec, "c");
+            printf(spec, (int)raw);
+        }
+        else
+        {
+            //sign extend
+            value = raw;
+            if((conv == 'd' || conv == 'i')
+                    && (raw & (UINT32_C(1) << (8*size - 1))))
+                value -= (long long)1 << (8*size);
+            strcat(spec, "ll");
+            strncat(spec, &conv, 1);
+            printf(spec, value);
+        }
+    }
+}
+
+/**
+ * Decodes records from stdin until EOF.
+ * Unknown or inconsistent records are skipped byte by byte
+ * until the stream is in sync again.
+ * 
+ * @return number of skipped bytes
+ */
+static unsigned long binlog_decode(void)
+{
+    uint8_t buf[BINLOG_HEADER_LEN + 0xFF];
+    size_t n = 0, len;
+    unsigned long skipped = 0;
+    uint16_t id;
+    int c;
+    
+    
+    while(1)
+    {
+        //fill up to the header
+        if(n < BINLOG_HEADER_LEN)
+        {
+            if((c = getchar()) == EOF)
+                break;
+            buf[n++] = c;
+            continue;
+        }
+        
+        //check the header once it's complete
+        id = buf[0] | (buf[1] << 8);
+        if(n == BINLOG_HEADER_LEN && (!binlog_formats[id]
+                || binlog_argsLen(binlog_formats[id]) != buf[2]))
+        {
+            //out of sync, drop a byte
+            memmove(buf, buf+1, --n);
+            skipped++;
+            continue;
+        }
+        
+        //fill up to the whole record
+        len = BINLOG_HEADER_LEN + buf[2];
+        if(n < len)
+        {
+            if((c = getchar()) == EOF)
+                break;
+            buf[n++] = c;
+            continue;
+        }
+        
+        binlog_print(binlog_formats[id], &buf[BINLOG_HEADER_LEN]);
+        fflush(stdout);
+        n = 0;
+    }
+    
+    return skipped;
+}
+
+
+
+int main(int argc, char **argv)
+{
+    int i, n;
+    unsigned long skipped;
+    
+    
+    if(argc >= 3 && !strcmp(argv[1], "table"))
+    {
+        for(i=2; i<argc; i++)
+            if((n = binlog_table(argv[i])) < 0)
+            {
+                fprintf(stderr, "can't read %s\n", argv[i]);
+                return 1;
+            }
+        return 0;
+    }
+    
+    if(argc == 3 && !strcmp(argv[1], "decode"))
+    {
+        if(binlog_load(argv[2]) < 0)
+        {
+            fprintf(stderr, "can't read %s\n", argv[2]);
+            return 1;
+        }
+        if((skipped = binlog_decode()))
+            fprintf(stderr, "%lu bytes skipped\n", skipped);
+        return 0;
+    }
+    
+    fprintf(stderr, "usage: %s table <source files> > <table>\n"
+        "       %s decode <table> < <stream>\n", argv[0], argv[0]);
+    return 1;
+}
@@ -0,0 +1,521 @@
+/*
+ * sdsim.c
+ * 
+ * Host side test of sd.c against a simulated SD card.
+ * 
+ * Author:      Sebastian Goessl
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+
+/*
+ * Build with the makefile in this folder (native compiler, not avr-gcc).
+ * 
+ * Implements the spi.h functions used by sd.c with a simulated card
+ * (SPI mode command set, multi-block transfers, busy and delay bytes)
+ * and runs the driver against it for SD v1, v2 and v2 high capacity:
+ *     ./sdsim
+ */
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spi.h"
+#include "sd.h"
+
+
+
+/** Simulated card size in sectors. */
+#define SIM_SECTORS 1024
+/** Maximum number of queued response bytes. */
+#define SIM_QUEUE_LEN 2048
+
+
+
+/** Simulated card types. */
+enum {SIM_V1, SIM_V2, SIM_V2HC};
+
+/** Receiver states of the card. */
+enum {SIM_COMMAND, SIM_WRITE_TOKEN, SIM_WRITE_DATA};
+
+/** Content of the card. */
+static uint8_t sim_card[SIM_SECTORS][SD_SECTOR_LEN];
+/** Type of the card. */
+static int sim_type;
+/** Chip select port (bit 0). */
+static volatile uint8_t sim_port = 0xFF;
+/** Prescaler index of the applied configuration (0 fastest). */
+static uint8_t sim_prescaler;
+
+/** Bytes the card shifts out next. */
+static uint8_t sim_queue[SIM_QUEUE_LEN];
+static size_t sim_queueHead, sim_queueTail;
+
+/** Command being received. */
+static uint8_t sim_cmd[6];
+static size_t sim_cmdLen;
+/** Receiver state, data block being received. */
+static int sim_state;
+static uint8_t sim_block[SD_SECTOR_LEN + 2];
+static size_t sim_blockLen;
+/** If the card is still initializing and the next command is an ACMD. */
+static bool sim_idle, sim_app;
+/** ACMD41s until the card is ready. */
+static int sim_initTries;
+/** Multi-block transfers ongoing and their next sector. */
+static bool sim_reading, sim_multiWrite;
+static uint32_t sim_sector;
+
+/** Command counters (ACMDs at 64+). */
+static unsigned long sim_commands[128];
+/** Bytes shifted at the fast clock. */
+static unsigned long sim_fastBytes;
+
+
+
+//spi.h functions used by sd.c
+
+Spi_config_t spi_initConfig(uint32_t frequency, uint8_t mode, uint8_t dord)
+{
+    uint32_t f = 16000000UL/2;
+    uint8_t i;
+    
+    (void)mode;
+    (void)dord;
+    for(i=0; i<6 && f>frequency; i++)
+        f /= 2;
+    
+    return (Spi_config_t){.spcr = i, .spsr = 0};
+}
+
+Spi_device_t spi_initDevice(uint32_t frequency, uint8_t mode, uint8_t dord,
+    volatile uint8_t *port, uint8_t pin)
+{
+    return (Spi_device_t){.config = spi_initConfig(frequency, mode, dord),
+        .port = port, .pin = pin};
+}
+
+void spi_setConfig(Spi_config_t config)
+{
+    sim_prescaler = config.spcr;
+}
+
+void spi_select(const Spi_device_t *device)
+{
+    spi_setConfig(device->config);
+    *device->port &= ~(1 << device->pin);
+}
+
+void spi_deselect(const Spi_device_t *device)
+{
+    *device->port |= (1 << device->pin);
+}
+
+
+
+/** Queues bytes the card shifts out. */
+static void sim_push(const uint8_t *data, size_t len)
+{
+    while(len--)
+    {
+        sim_queue[sim_queueTail] = *data++;
+        sim_queueTail = (sim_queueTail + 1) % SIM_QUEUE_LEN;
+    }
+}
+
+static void sim_pushByte(uint8_t data)
+{
+    sim_push(&data, 1);
+}
+
+/** Queues a data block (with access delay) of a sector. */
+static void sim_pushBlock(uint32_t sector)
+{
+    sim_pushByte(0xFF);
+    sim_pushByte(0xFF);
+    sim_pushByte(0xFE);
+    sim_push(sim_card[sector], SD_SECTOR_LEN);
+    sim_pushByte(0x12);
+    sim_pushByte(0x34);
+}
+
+/** Queues an R1 response after one byte of command response time. */
+static void sim_r1(uint8_t r1)
+{
+    sim_pushByte(0xFF);
+    sim_pushByte(r1 | sim_idle);
+}
+
+/** Converts the command argument into a sector, -1 if invalid. */
+static long sim_address(uint32_t arg)
+{
+    if(sim_type != SIM_V2HC)
+    {
+        if(arg % SD_SECTOR_LEN)
+            return -1;
+        arg /= SD_SECTOR_LEN;
+    }
+    
+    return (arg < SIM_SECTORS) ? (long)arg : -1;
+}
+
+/** Executes a received command. */
+static void sim_execute(void)
+{
+    uint8_t cmd = sim_cmd[0] & 0x3F;
+    uint32_t arg = ((uint32_t)sim_cmd[1] << 24) | ((uint32_t)sim_cmd[2] << 16)
+        | ((uint32_t)sim_cmd[3] << 8) | sim_cmd[4];
+    bool app = sim_app;
+    long sector;
+    uint8_t r7[4];
+    
+    
+    sim_app = false;
+    sim_commands[cmd + (app ? 64 : 0)]++;
+    
+    if(cmd == 0)
+    {
+        sim_queueHead = sim_queueTail;
+        sim_reading = sim_multiWrite = false;
+        sim_idle = true;
+        sim_initTries = 3;
+        sim_r1((sim_cmd[5] == 0x95) ? 0x00 : 0x08);
+        return;
+    }
+    
+    if(cmd == 12)
+    {
+        //drop the data being sent, stuff byte, R1 and some busy bytes
+        sim_queueHead = sim_queueTail;
+        sim_reading = false;
+        sim_pushByte(0xFF);
+        sim_pushByte(0xFF);
+        sim_pushByte(0x00);
+        sim_pushByte(0x00);
+        sim_pushByte(0x00);
+        return;
+    }
+    
+    if(sim_idle && !(cmd == 8 || cmd == 55 || cmd == 58
+            || (app && cmd == 41)))
+    {
+        sim_r1(0x04);
+        return;
+    }
+    
+    switch(cmd + (app ? 64 : 0))
+    {
+        case 8:
+            if(sim_type == SIM_V1)
+            {
+                sim_r1(0x04);
+                break;
+            }
+            sim_r1((sim_cmd[5] == 0x87) ? 0x00 : 0x08);
+            r7[0] = r7[1] = 0x00;
+            r7[2] = (arg >> 8) & 0x0F;
+            r7[3] = arg;
+            sim_push(r7, sizeof(r7));
+            break;
+        
+        case 55:
+            sim_app = true;
+            sim_r1(0x00);
+            break;
+        
+        case 64+41:
+            if(sim_initTries && !--sim_initTries)
+                sim_idle = false;
+            sim_r1(0x00);
+            break;
+        
+        case 58:
+            sim_r1(0x00);
+            r7[0] = (sim_type == SIM_V2HC) ? 0xC0 : 0x80;
+            r7[1] = 0xFF;
+            r7[2] = 0x80;
+            r7[3] = 0x00;
+            sim_push(r7, sizeof(r7));
+            break;
+        
+        case 16:
+            sim_r1((arg == SD_SECTOR_LEN) ? 0x00 : 0x40);
+            break;
+        
+        case 17:
+        case 18:
+            sector = sim_address(arg);
+            if(sector < 0)
+            {
+                sim_r1(0x20);
+                break;
+            }
+            sim_r1(0x00);
+            sim_pushBlock(sector);
+            sim_sector = sector + 1;
+            sim_reading = (cmd == 18);
+            break;
+        
+        case 64+23:
+            sim_r1(0x00);
+            break;
+        
+        case 24:
+        case 25:
+            sector = sim_address(arg);
+            if(sector < 0)
+            {
+                sim_r1(0x20);
+                break;
+            }
+            sim_r1(0x00);
+            sim_sector = sector;
+            sim_multiWrite = (cmd == 25);
+            sim_state = SIM_WRITE_TOKEN;
+            break;
+        
+        default:
+            sim_r1(0x04);
+    }
+}
+
+/** Processes a byte received by the card. */
+static void sim_receive(uint8_t data)
+{
+    static const uint8_t busy[] = {0x00, 0x00, 0x00, 0x00};
+    
+    
+    switch(sim_state)
+    {
+        case SIM_WRITE_TOKEN:
+            if(data == (sim_multiWrite ? 0xFC : 0xFE))
+            {
+                sim_state = SIM_WRITE_DATA;
+                sim_blockLen = 0;
+            }
+            else if(sim_multiWrite && data == 0xFD)
+            {
+                sim_pushByte(0xFF);
+                sim_push(busy, sizeof(busy));
+                sim_multiWrite = false;
+                sim_state = SIM_COMMAND;
+            }
+            break;
+        
+        case SIM_WRITE_DATA:
+            //data and CRC
+            sim_block[sim_blockLen++] = data;
+            if(sim_blockLen < sizeof(sim_block))
+                break;
+            
+            if(sim_sector < SIM_SECTORS)
+            {
+                memcpy(sim_card[sim_sector++], sim_block, SD_SECTOR_LEN);
+                sim_pushByte(0xE5);
+            }
+            else
+            {
+                //write error
+                sim_pushByte(0xED);
+            }
+            sim_push(busy, sizeof(busy));
+            sim_state = sim_multiWrite ? SIM_WRITE_TOKEN : SIM_COMMAND;
+            break;
+        
+        default:
+            if(!sim_cmdLen && (data & 0xC0) != 0x40)
+                break;
+            
+            sim_cmd[sim_cmdLen++] = data;
+            if(sim_cmdLen == sizeof(sim_cmd))
+            {
+                sim_cmdLen = 0;
+                sim_execute();
+            }
+    }
+}
+
+uint8_t spi_writeRead(uint8_t data)
+{
+    uint8_t ret = 0xFF;
+    
+    
+    //not selected, MISO floats high
+    if(sim_port & 0x01)
+        return 0xFF;
+    
+    if(!sim_prescaler)
+        sim_fastBytes++;
+    
+    if(sim_queueHead == sim_queueTail && sim_reading)
+        sim_pushBlock(sim_sector++ % SIM_SECTORS);
+    
+    if(sim_queueHead != sim_queueTail)
+    {
+        ret = sim_queue[sim_queueHead];
+        sim_queueHead = (sim_queueHead + 1) % SIM_QUEUE_LEN;
+    }
+    
+    sim_receive(data);
+    return ret;
+}
+
+void spi_writeBurst(uint8_t *out, size_t len)
+{
+    while(len--)
+        spi_writeRead(*out++);
+}
+
+void spi_readBurstFill(uint8_t *in, size_t len, uint8_t fill)
+{
+    while(len--)
+        *in++ = spi_writeRead(fill);
+}
+
+
+
+/** Number of failed checks. */
+static int sim_failed = 0;
+
+/** Reports a check. */
+static void check(bool ok, const char *what)
+{
+    if(!ok)
+    {
+        printf("    FAILED: %s\n", what);
+        sim_failed++;
+    }
+}
+
+/** Fills a buffer with a pattern depending on the seed. */
+static void pattern(uint8_t *data, size_t len, unsigned seed)
+{
+    while(len--)
+    {
+        seed = seed*1103515245 + 12345;
+        *data++ = seed >> 16;
+    }
+}
+
+/** Runs the driver tests against a card of the given type. */
+static void run(int type, Sd_type_t expected, const char *name)
+{
+    static uint8_t data[8*SD_SECTOR_LEN], back[8*SD_SECTOR_LEN];
+    unsigned long before;
+    uint8_t *c;
+    
+    
+    printf("%s\n", name);
+    memset(sim_card, 0, sizeof(sim_card));
+    memset(sim_commands, 0, sizeof(sim_commands));
+    sim_type = type;
+    sim_state = SIM_COMMAND;
+    sim_cmdLen = 0;
+    sim_queueHead = sim_queueTail = 0;
+    
+    before = sim_fastBytes;
+    check(!sd_init(&sim_port, 0), "initialization");
+    check(sd_type() == expected, "card type");
+    check(sim_fastBytes == before, "slow init clock");
+    
+    //multi-block write and read
+    pattern(data, sizeof(data), type);
+    before = sim_fastBytes;
+    check(!sd_write(10, data, 8), "multi-block write");
+    check(sim_fastBytes > before, "fast clock after init");
+    check(sim_commands[25] == 1 && sim_commands[24] == 0, "CMD25 used");
+    check(sim_commands[64+23] == 1, "ACMD23 used");
+    check(!memcmp(sim_card[10], data, sizeof(data)), "card content");
+    check(!sd_read(10, back, 8), "multi-block read");
+    check(sim_commands[18] == 1 && sim_commands[17] == 0, "CMD18 used");
+    check(sim_commands[12] == 1, "CMD12 sent");
+    check(!memcmp(back, data, sizeof(data)), "read content");
+    check(!sd_read(13, back, 1), "single block read");
+    check(sim_commands[17] == 1, "CMD17 used");
+    check(!memcmp(back, data + 3*SD_SECTOR_LEN, SD_SECTOR_LEN),
+        "single block content");
+    check(sd_read(SIM_SECTORS, back, 1), "out of range read fails");
+    
+    //cache hits don't touch the card
+    before = sim_commands[17];
+    c = sd_cache(11, false);
+    check(c && !memcmp(c, data + SD_SECTOR_LEN, SD_SECTOR_LEN),
+        "cached content");
+    check(sd_cache(11, false) == c, "cache hit");
+    check(sim_commands[17] == before + 1, "one read per miss");
+    
+    //write-back, visible to sd_read before the sync
+    c = sd_cache(11, true);
+    memset(c, 0xAB, SD_SECTOR_LEN);
+    check(sim_card[11][0] != 0xAB, "written back lazily");
+    check(!sd_read(10, back, 3), "read around dirty sector");
+    check(back[SD_SECTOR_LEN] == 0xAB && back[0] == data[0],
+        "read sees cached data");
+    check(!sd_sync(), "sync");
+    check(sim_card[11][0] == 0xAB && sim_card[11][511] == 0xAB,
+        "synced content");
+    
+    //least recently used eviction writes back
+    c = sd_cache(20, true);
+    c[0] = 0x20;
+    c = sd_cache(21, true);
+    c[0] = 0x21;
+    sd_cache(20, false);
+    before = sim_commands[24];
+    sd_cache(22, false);
+    check(sim_commands[24] == before + 1 && sim_card[21][0] == 0x21
+        && sim_card[20][0] != 0x20, "LRU eviction");
+    
+    //direct writes drop cached copies
+    memset(data, 0x5A, SD_SECTOR_LEN);
+    check(!sd_write(20, data, 1), "single block write");
+    check(sim_commands[24] == before + 2, "CMD24 used");
+    c = sd_cache(20, false);
+    check(c && c[0] == 0x5A, "cache dropped on write");
+    check(!sd_sync(), "final sync");
+}
+
+int main(void)
+{
+    run(SIM_V2HC, SD_V2HC, "SD v2 high capacity");
+    run(SIM_V2, SD_V2, "SD v2 standard capacity");
+    run(SIM_V1, SD_V1, "SD v1");
+    
+    if(sim_failed)
+    {
+        printf("%d checks failed\n", sim_failed);
+        return EXIT_FAILURE;
+    }
+    
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+/*
+ * telemetry.c
+ * 
+ * Host side decoder for telemetry.h streams.
+ * 
+ * Author:      Sebastian Goessl
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+/*
+ * Build with the makefile in this folder (native compiler, not avr-gcc).
+ * 
+ * Decode a captured stream with e.g. 8 channels into CSV lines
+ * (sequence number and one column per channel):
+ *     ./telemetry 8 < /dev/ttyACM0
+ * Use -u to print the channels as unsigned values (e.g. ADC samples):
+ *     ./telemetry -u 8 < /dev/ttyACM0
+ */
+
+
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+/** Header flag of a keyframe record (see telemetry.h). */
+#define TELEMETRY_KEY 0x80
+/** Header mask of the sequence number (see telemetry.h). */
+#define TELEMETRY_SEQ 0x7F
+/** Frame delimiter (see telemetry.h). */
+#define TELEMETRY_DELIMITER 0x00
+/** CRC-8 polynomial of the check byte (see telemetry.h). */
+#define TELEMETRY_CRC_POLY 0x07
+/** Maximum number of channels (see telemetry.h). */
+#define TELEMETRY_N_MAX 83
+/** Maximum length of a record (see telemetry.h). */
+#define TELEMETRY_RECORD_MAX (2 + 3*TELEMETRY_N_MAX)
+
+
+
+/**
+ * Reads a frame from stdin up to the delimiter and COBS decodes it.
+ * 
+ * @param record location for the record (TELEMETRY_RECORD_MAX bytes)
+ * @return length of the record, 0 for a corrupted frame, -1 on EOF
+ */
+static int telemetry_frame(uint8_t *record)
+{
+    int c, len = 0, left = 0, zero = 0, code = 0, bad = 0;
+    
+    while((c = getchar()) != TELEMETRY_DELIMITER)
+    {
+        if(c == EOF)
+            return -1;
+        
+        if(!left)
+        {
+            //code byte, the previous block ended with an implicit zero
+            if(zero)
+            {
+                if(len < TELEMETRY_RECORD_MAX)
+                    record[len++] = 0;
+                else
+                    bad = 1;
+            }
+            left = c - 1;
+            zero = (c < 0xFF);
+            code = 1;
+        }
+        else
+        {
+            if(len < TELEMETRY_RECORD_MAX)
+                record[len++] = c;
+            else
+                bad = 1;
+            left--;
+        }
+    }
+    
+    return (bad || left || !code) ? 0 : len;
+}
+
+/**
+ * Computes the CRC-8 check byte of a record.
+ * 
+ * @param p location of the record
+ * @param len length of the record without the check byte
+ * @return the check byte
+ */
+static uint8_t telemetry_crc(const uint8_t *p, int len)
+{
+    uint8_t crc = 0;
+    int i;
+    
+    while(len--)
+    {
+        crc ^= *p++;
+        for(i=0; i<8; i++)
+            crc = (crc & 0x80) ? (crc << 1) ^ TELEMETRY_CRC_POLY : crc << 1;
+    }
+    
+    return crc;
+}
+
+/**
+ * Reads a zigzag varint from a record.
+ * 
+ * @param p location of the reading position, advanced
+ * @param end location after the record
+ * @param value location for the decoded value
+ * @return 0 on success, 1 on a truncated or overlong varint
+ */
+static int telemetry_varint(const uint8_t **p, const uint8_t *end,
+    int16_t *value)
+{
+    uint32_t z = 0;
+    int c, shift = 0;
+    
+    do
+    {
+        if(*p >= end || shift > 14)
+            return 1;
+        c = *(*p)++;
+        z |= (uint32_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while(c & 0x80);
+    
+    *value = (int16_t)((z >> 1) ^ -(z & 1));
+    return 0;
+}
+
+
+
+int main(int argc, char **argv)
+{
+    int16_t values[TELEMETRY_N_MAX], v[TELEMETRY_N_MAX];
+    uint8_t record[TELEMETRY_RECORD_MAX];
+    const uint8_t *p;
+    int n, i, c, len, isUnsigned = 0, synced = 0;
+    unsigned seq = 0;
+    unsigned long lost = 0;
+    
+    
+    if(argc == 3 && !strcmp(argv[1], "-u"))
+    {
+        isUnsigned = 1;
+        argv++;
+        argc--;
+    }
+    if(argc != 2 || (n = atoi(argv[1])) <= 0 || n > TELEMETRY_N_MAX)
+    {
+        fprintf(stderr, "usage: %s [-u] <channels> < <stream>\n", argv[0]);
+        return 1;
+    }
+    
+    
+    while((len = telemetry_frame(record)) >= 0)
+    {
+        //a record has to pass the check and hold exactly n varints
+        if(len < 2 || telemetry_crc(record, len - 1) != record[len - 1])
+            len = 0;
+        else
+            len--;
+        p = record + 1;
+        for(i=0; len && i<n; i++)
+            if(telemetry_varint(&p, record + len, &v[i]))
+                break;
+        c = record[0];
+        
+        //wait for a keyframe after start, a corrupted record
+        //or a gap in the sequence
+        if(!len || i < n || p != record + len
+                || (synced && (c & TELEMETRY_SEQ) != seq))
+        {
+            if(synced)
+                lost++;
+            synced = 0;
+            if(!len || i < n || p != record + len)
+                continue;
+        }
+        if(!synced && !(c & TELEMETRY_KEY))
+            continue;
+        synced = 1;
+        seq = ((c & TELEMETRY_SEQ) + 1) & TELEMETRY_SEQ;
+        
+        printf("%u", c & TELEMETRY_SEQ);
+        for(i=0; i<n; i++)
+        {
+            //differences wrap around like on the device
+            values[i] = (c & TELEMETRY_KEY) ? v[i]
+                : (int16_t)((uint16_t)values[i] + (uint16_t)v[i]);
+            if(isUnsigned)
+                printf(",%u", (uint16_t)values[i]);
+            else
+                printf(",%d", values[i]);
+        }
+        putchar('\n');
+        fflush(stdout);
+    }
+    
+    if(lost)
+        fprintf(stderr, "lost sync %lu times\n", lost);
+    return 0;
+}
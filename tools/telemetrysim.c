@@ -0,0 +1,234 @@
+/*
+ * telemetrysim.c
+ * 
+ * Host side test of the telemetry.c encoder against the telemetry decoder.
+ * 
+ * Author:      Sebastian Goessl
+ * 
+ * LICENSE:
+ * MIT License
+ * 
+ * Copyright (c) 2019 Sebastian Goessl
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ */
+
+
+
+
+
+/*
+ * Build with the makefile in this folder (native compiler, not avr-gcc).
+ * 
+ * Implements the uartint.h function used by telemetry.c with a capture
+ * buffer, encodes a known signal, damages the stream and checks
+ * what the telemetry decoder (built next to it) makes of it:
+ *     ./telemetrysim
+ */
+
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "uartint.h"
+#include "telemetry.h"
+
+
+
+/** Number of channels. */
+#define SIM_N 3
+/** Number of records from keyframe to keyframe. */
+#define SIM_INTERVAL 10
+/** Number of records. */
+#define SIM_RECORDS 65
+/** Capacity of the capture buffer. */
+#define SIM_STREAM_LEN (SIM_RECORDS*TELEMETRY_FRAME_MAX)
+/** Temporary file for the decoder input. */
+#define SIM_FILE "telemetrysim.bin"
+
+
+
+/** Captured stream. */
+static uint8_t sim_stream[SIM_STREAM_LEN];
+/** Number of captured bytes. */
+static size_t sim_len;
+/** Start offset of every record in the capture. */
+static size_t sim_offsets[SIM_RECORDS];
+/** Rejects the next transmission if set. */
+static bool sim_full;
+
+bool uartint_transmitTry(uint8_t *data, size_t len)
+{
+    if(sim_full || sim_len + len > SIM_STREAM_LEN)
+        return 1;
+    
+    memcpy(sim_stream + sim_len, data, len);
+    sim_len += len;
+    return 0;
+}
+
+
+
+/** Number of failed checks. */
+static int sim_failed = 0;
+
+/** Reports a check. */
+static void check(bool ok, const char *what)
+{
+    if(!ok)
+    {
+        printf("    FAILED: %s\n", what);
+        sim_failed++;
+    }
+}
+
+/**
+ * Sample of a channel in a record. Large steps produce varint
+ * continuation bytes, constant stretches produce zero bytes.
+ */
+static int16_t sample(int record, int channel)
+{
+    switch(channel)
+    {
+        case 0:
+            return record*1000 - 20000;
+        case 1:
+            return (record/4)*3;
+        default:
+            return (record & 1) ? -0x4000 : 0x3FFF;
+    }
+}
+
+/** Encodes the signal into the capture buffer. */
+static void encode(void)
+{
+    int16_t last[SIM_N], samples[SIM_N];
+    Telemetry_t stream = telemetry_init(last, SIM_N, SIM_INTERVAL);
+    int r, i;
+    
+    
+    sim_len = 0;
+    for(r=0; r<SIM_RECORDS; r++)
+    {
+        //a record rejected by a full transmit buffer
+        //must not desynchronize the host
+        if(r == 5)
+        {
+            for(i=0; i<SIM_N; i++)
+                samples[i] = sample(r, i) + 7;
+            sim_full = true;
+            check(telemetry_write(&stream, samples), "full buffer drops");
+            sim_full = false;
+        }
+        
+        for(i=0; i<SIM_N; i++)
+            samples[i] = sample(r, i);
+        sim_offsets[r] = sim_len;
+        check(!telemetry_write(&stream, samples), "write");
+    }
+    check(stream.dropped == 1, "dropped count");
+}
+
+/**
+ * Decodes the capture with one byte removed (or none for skip < 0)
+ * and checks every decoded row against the signal.
+ * 
+ * @param skip offset of the byte to remove, negative for none
+ * @param rows location for the number of decoded rows
+ * @return sequence number of the first row after the removed byte or -1
+ */
+static int decode(long skip, int *rows)
+{
+    char line[256];
+    FILE *f;
+    size_t i;
+    int seq, v[SIM_N], r = -1, after = -1, ch;
+    
+    
+    f = fopen(SIM_FILE, "wb");
+    for(i=0; i<sim_len; i++)
+        if((long)i != skip)
+            fputc(sim_stream[i], f);
+    fclose(f);
+    
+    *rows = 0;
+    //SIM_N channels
+    f = popen("./telemetry 3 < " SIM_FILE " 2>/dev/null", "r");
+    while(fgets(line, sizeof(line), f))
+    {
+        if(sscanf(line, "%d,%d,%d,%d", &seq, &v[0], &v[1], &v[2]) != 4)
+        {
+            check(false, "row format");
+            continue;
+        }
+        
+        //records are numbered from 0 without wrap in this test
+        for(ch=0; ch<SIM_N; ch++)
+            check(v[ch] == sample(seq, ch), "decoded value");
+        check(seq > r, "rows in order");
+        if(skip >= 0 && after < 0 && (size_t)skip < sim_offsets[seq])
+            after = seq;
+        r = seq;
+        (*rows)++;
+    }
+    pclose(f);
+    remove(SIM_FILE);
+    
+    return after;
+}
+
+int main(void)
+{
+    int rows, after, r, last;
+    long skip;
+    
+    
+    printf("intact stream\n");
+    encode();
+    decode(-1, &rows);
+    check(rows == SIM_RECORDS, "all rows decoded");
+    
+    //drop every single byte in turn (varint continuation bytes included)
+    printf("dropped bytes\n");
+    for(skip=sim_offsets[1];
+        skip<(long)sim_offsets[SIM_RECORDS-SIM_INTERVAL]; skip++)
+    {
+        for(r=1; (long)sim_offsets[r+1] <= skip; r++)
+            ;
+        after = decode(skip, &rows);
+        //the damaged record and everything up to the next keyframe is lost,
+        //without its delimiter the damaged record swallows the next one
+        last = (skip == (long)sim_offsets[r+1] - 1) ? r + 1 : r;
+        check(after == (last/SIM_INTERVAL + 1)*SIM_INTERVAL,
+            "recovered at the next keyframe");
+        check(rows == SIM_RECORDS - (after - r), "rows after recovery");
+    }
+    
+    if(sim_failed)
+    {
+        printf("%d checks failed\n", sim_failed);
+        return EXIT_FAILURE;
+    }
+    
+    printf("all checks passed\n");
+    return EXIT_SUCCESS;
+}